@@ -4,6 +4,7 @@
 #include <iostream>
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "profiler.h"
 
 using namespace std;
 using namespace cv;
@@ -17,17 +18,22 @@ int main()
         cap.set(CV_CAP_PROP_FRAME_HEIGHT, 240);
 
         Mat im, im_g;
-        double time = 0;
-        unsigned int frames = 0;
+
+        // Per-stage timings and the frame rate are written to profile.csv every second
+        stageProfiler &prof = stageProfiler::instance();
+        const int frame = prof.stage_id("frame"), capture = prof.stage_id("capture"), convert = prof.stage_id("convert"), draw = prof.stage_id("draw");
+        prof.start_dump("profile.csv", 1);
+
   	while(char(waitKey(1)) != 'q') {
-            double t0 = getTickCount();
+            scopedTimer frame_timer(frame), t(capture);
             cap >> im;
+            t.next(convert);
             cvtColor(im, im_g, CV_BGR2GRAY);
-            frames++;
+            t.next(draw);
             imshow("Hello", im_g);
-            time += (getTickCount() - t0) / getTickFrequency();
-            cout << frames / time << " fps" << endl;
   	}
 
+        prof.stop_dump();
+
  	return 0;
 }
@@ -4,6 +4,7 @@
 #include "cap.h"
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "profiler.h"
 
 using namespace cv;
 using namespace std;
@@ -14,18 +15,21 @@ int main() {
     PiCapture cap(320, 240, false);
 
     Mat im;
-    double time = 0;
-    unsigned int frames = 0;
+
+    // Per-stage timings and the frame rate are written to profile.csv every second
+    stageProfiler &prof = stageProfiler::instance();
+    const int frame = prof.stage_id("frame"), capture = prof.stage_id("capture"), draw = prof.stage_id("draw");
+    prof.start_dump("profile.csv", 1);
+
     while(char(waitKey(1)) != 'q') {
-        double t0 = getTickCount();
+        scopedTimer frame_timer(frame), t(capture);
         im = cap.grab();
-        frames++;
+        t.next(draw);
         if(!im.empty()) imshow("Hello", im);
         else cout << "Frame dropped" << endl;
-
-        time += (getTickCount() - t0) / getTickFrequency();
-        cout << frames / time << " fps" << endl;
     }
 
+    prof.stop_dump();
+
     return 0;
 }
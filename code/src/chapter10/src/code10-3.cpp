@@ -5,6 +5,7 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "profiler.h"
 
 using namespace cv;
 using namespace std;
@@ -78,12 +79,14 @@ int main()
         createTrackbar("Low threshold", "Segmentation", &low_slider, 255, on_low_thresh_trackbar);
         createTrackbar("High threshold", "Segmentation", &high_slider, 255, on_high_thresh_trackbar);
 
-        double time = 0;
-        unsigned int frames = 0;
+        // Per-stage timings and the frame rate are written to profile.csv every second
+        stageProfiler &prof = stageProfiler::instance();
+        const int frame_stage = prof.stage_id("frame"), capture = prof.stage_id("capture"), thresh = prof.stage_id("threshold"), draw = prof.stage_id("draw");
+        prof.start_dump("profile.csv", 1);
+
 	while(char(waitKey(1)) != 'q')
 	{
-                frames++;
-                double t0 = getTickCount();
+                scopedTimer frame_timer(frame_stage), t(capture);
 		frame = cap.grab();
 		// Check if the video is over
 		if(frame.empty())
@@ -92,13 +95,15 @@ int main()
 			continue;
 		}
                 
+                t.next(thresh);
                 inRange(frame, Scalar(low_b, low_g, low_r), Scalar(high_b, high_g, high_r), frame_thresholded);
 		
+                t.next(draw);
                 imshow("Video", frame);
                 imshow("Segmentation", frame_thresholded);
-                time += (getTickCount() - t0) / getTickFrequency();
-                cout << frames / time << " fps" << endl;
 	}
 
+        prof.stop_dump();
+
 	return 0;
 }
@@ -6,6 +6,7 @@
 #include <opencv2/nonfree/features2d.hpp>
 #include <opencv2/features2d/features2d.hpp>
 #include "cap.h"
+#include "profiler.h"
 
 using namespace cv;
 using namespace std;
@@ -31,10 +32,14 @@ int main() {
     // PiCapture object
     PiCapture cap(320, 240, false);
 
-    unsigned int frame_count = 0;
+    // Per-stage timings and the frame rate are written to profile.csv every second
+    stageProfiler &prof = stageProfiler::instance();
+    const int frame = prof.stage_id("frame"), capture = prof.stage_id("capture"), detect = prof.stage_id("detect"),
+              describe = prof.stage_id("describe"), match = prof.stage_id("match"), draw = prof.stage_id("draw");
+    prof.start_dump("profile.csv", 1);
 
     while(char(waitKey(1)) != 'q') {
-        double t0 = getTickCount();
+        scopedTimer frame_timer(frame), t(capture);
         Mat test_g = cap.grab();
         if(test_g.empty())
             continue;
@@ -42,10 +47,13 @@ int main() {
         //detect SIFT keypoints and extract descriptors in the test image
         vector<KeyPoint> test_kp;
         Mat test_desc;
+        t.next(detect);
         featureDetector.detect(test_g, test_kp);
+        t.next(describe);
         featureExtractor.compute(test_g, test_kp, test_desc);
 
         // match train and test descriptors, getting 2 nearest neighbors for all test descriptors
+        t.next(match);
         Mat match_idx(test_desc.rows, 2, CV_32SC1), match_dist(test_desc.rows, 2, CV_32FC1);
         flannIndex.knnSearch(test_desc, match_idx, match_dist, 2, flann::SearchParams());
 
@@ -58,12 +66,13 @@ int main() {
             }
         }
 
+        t.next(draw);
         Mat img_show;
         drawMatches(test_g, test_kp, train, train_kp, good_matches, img_show);
         imshow("Matches", img_show);
-
-        cout << "Frame rate = " << getTickFrequency() / (getTickCount() - t0) << endl;
     }
 
+    prof.stop_dump();
+
     return 0;
 }
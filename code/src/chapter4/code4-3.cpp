@@ -1,17 +1,120 @@
 // Program to display a video from a file
+// Frames are decoded on a background thread into a bounded ring of preallocated frames
 // Author: Samarth Manoj Brahmbhatt, University of Pennsylvania
 // Video from: http://ftp.nluug.nl/ftp/graphics/blender/apricot/trailer/sintel_trailer-480p.mp4
+// Compile with: g++ code4-3.cpp -o code4-3 `pkg-config --cflags --libs opencv` -lboost_thread -lboost_system
 
 #include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include "../include/headless.h"
 
 using namespace cv;
 using namespace std;
 
-int main()
+// Class holding a fixed number of preallocated frames shared by one decoder (producer) and one consumer
+class frameRing {
+	private:
+		vector<Mat> slots; // frame buffers, reused for the whole video
+		int head, tail, count; // index of oldest full slot, index of next free slot, number of full slots
+		bool finished; // set by the producer when the video is over
+		boost::mutex mtx;
+		boost::condition_variable not_empty, not_full;
+
+		// statistics
+		unsigned long pushed, depth_sum, max_depth, decoder_stalls, ring_full_waits;
+	public:
+		frameRing(int size, Size frame_size, int type) { // constructor
+			for(int i = 0; i < size; i++) slots.push_back(Mat(frame_size, type));
+			head = tail = count = 0;
+			finished = false;
+			pushed = depth_sum = max_depth = decoder_stalls = ring_full_waits = 0;
+		}
+
+		Mat & acquire_free(); // producer: wait for a free slot and return it for decoding into
+		void commit(); // producer: publish the slot returned by acquire_free()
+		void finish(); // producer: no more frames will be committed
+		bool acquire_full(Mat &); // consumer: wait for the oldest decoded frame, false when the video is over
+		void release(); // consumer: give the slot returned by acquire_full() back to the producer
+		void print_stats();
+};
+
+Mat & frameRing::acquire_free() {
+	boost::unique_lock<boost::mutex> lock(mtx);
+	if(count == int(slots.size())) ring_full_waits++;
+	while(count == int(slots.size())) not_full.wait(lock);
+	return slots[tail];
+}
+
+void frameRing::commit() {
+	{
+		boost::unique_lock<boost::mutex> lock(mtx);
+		tail = (tail + 1) % slots.size();
+		count++;
+		pushed++;
+		depth_sum += count;
+		max_depth = max(max_depth, (unsigned long)count);
+	}
+	not_empty.notify_one();
+}
+
+void frameRing::finish() {
+	{
+		boost::unique_lock<boost::mutex> lock(mtx);
+		finished = true;
+	}
+	not_empty.notify_one();
+}
+
+bool frameRing::acquire_full(Mat &frame) {
+	boost::unique_lock<boost::mutex> lock(mtx);
+	// consumer had to wait because the decoder fell behind
+	if(count == 0 && !finished) decoder_stalls++;
+	while(count == 0 && !finished) not_empty.wait(lock);
+	if(count == 0) return false;
+	// hand out a header to the slot, no pixels are copied
+	frame = slots[head];
+	return true;
+}
+
+void frameRing::release() {
+	{
+		boost::unique_lock<boost::mutex> lock(mtx);
+		head = (head + 1) % slots.size();
+		count--;
+	}
+	not_full.notify_one();
+}
+
+void frameRing::print_stats() {
+	boost::unique_lock<boost::mutex> lock(mtx);
+	cout << "Frames decoded: " << pushed << endl;
+	cout << "Average queue depth: " << (pushed ? double(depth_sum) / pushed : 0.) << " / " << slots.size() << endl;
+	cout << "Maximum queue depth: " << max_depth << endl;
+	cout << "Decoder stalls (display waited for a frame): " << decoder_stalls << endl;
+	cout << "Ring full waits (decoder waited for display): " << ring_full_waits << endl;
+}
+
+// Function run by the decoding thread
+void decode(VideoCapture *cap, frameRing *ring, boost::atomic<bool> *stop) {
+	while(!*stop) {
+		Mat &slot = ring->acquire_free();
+		// decode directly into the preallocated buffer
+		if(!cap->read(slot) || slot.empty()) break;
+		ring->commit();
+	}
+	ring->finish();
+}
+
+int main(int argc, char **argv)
 {
+	// Run with --headless <file> to benchmark without a display
+	headlessRunner hr(argc, argv);
+
 	// Create a VideoCapture object to read from video file
-	VideoCapture cap("video.mp4");
-	
+	VideoCapture cap;
+	hr.open(cap, "video.mp4");
+
 	//check if the file was opened properly
 	if(!cap.isOpened())
 	{
@@ -19,21 +122,42 @@ int main()
 		return -1;
 	}
 
-	namedWindow("Video");
+	if(!hr.is_headless()) namedWindow("Video");
+
+	// Ring of 8 frames in the native size of the video
+	Size S = Size((int) cap.get(CV_CAP_PROP_FRAME_WIDTH), (int) cap.get(CV_CAP_PROP_FRAME_HEIGHT));
+	frameRing ring(8, S, CV_8UC3);
+
+	// Start decoding in the background
+	boost::atomic<bool> stop(false);
+	boost::thread decoder(decode, &cap, &ring, &stop);
+
+	// profiler ids of the stages, looked up once outside of the frame loop
+	const int wait_decode_id = hr.stage_id("wait decode"), display_id = hr.stage_id("display");
 
 	// Play the video in a loop till it ends
-	while(char(waitKey(1)) != 'q' && cap.isOpened())
+	Mat frame;
+	while(hr.next())
 	{
-		Mat frame;
-		cap >> frame;
 		// Check if the video is over
-		if(frame.empty())
+		hr.stage(wait_decode_id);
+		if(!ring.acquire_full(frame))
 		{
 			cout << "Video over" << endl;
 			break;
 		}
-		imshow("Video", frame);
+		hr.stage(display_id);
+		hr.show("Video", frame);
+		ring.release();
 	}
 
+	// Unblock the decoder if it is waiting for a free slot and wait for it to exit
+	stop = true;
+	while(ring.acquire_full(frame)) ring.release();
+	decoder.join();
+
+	ring.print_stats();
+	hr.report();
+
 	return 0;
 }
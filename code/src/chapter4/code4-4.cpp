@@ -1,16 +1,22 @@
 // Program to display a video from attached default camera device
 // Author: Samarth Manoj Brahmbhatt, University of Pennsylvania
+// Compile with: g++ code4-4.cpp -o code4-4 `pkg-config --cflags --libs opencv` -lboost_thread -lboost_system
 
 #include <opencv2/opencv.hpp>
+#include "../include/headless.h"
 
 using namespace cv;
 using namespace std;
 
-int main()
+int main(int argc, char **argv)
 {
+	// Run with --headless <file> to benchmark without a display
+	headlessRunner hr(argc, argv);
+
 	// Create a VideoCapture object to read from video file
 	// 0 is the ID of the built-in laptop camera, change if you want to use other camera
-	VideoCapture cap(0);
+	VideoCapture cap;
+	hr.open(cap, 0);
 	
 	//check if the file was opened properly
 	if(!cap.isOpened())
@@ -19,12 +25,16 @@ int main()
 		return -1;
 	}
 
-	namedWindow("Video");
+	if(!hr.is_headless()) namedWindow("Video");
+
+	// profiler ids of the stages, looked up once outside of the frame loop
+	const int capture_id = hr.stage_id("capture"), display_id = hr.stage_id("display");
 
 	// Play the video in a loop till it ends
-	while(char(waitKey(1)) != 'q' && cap.isOpened())
+	while(hr.next() && cap.isOpened())
 	{
 		Mat frame;
+		hr.stage(capture_id);
 		cap >> frame;
 		// Check if the video is over
 		if(frame.empty())
@@ -32,8 +42,11 @@ int main()
 			cout << "Video over" << endl;
 			break;
 		}
-		imshow("Video", frame);
+		hr.stage(display_id);
+		hr.show("Video", frame);
 	}
 
+	hr.report();
+
 	return 0;
 }
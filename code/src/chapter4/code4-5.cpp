@@ -1,13 +1,140 @@
 // Program to write video from default amera device to file
+// Frames are encoded on a separate writer thread fed by a bounded queue so that encoding does not slow down capture
 // Author: Samarth Manoj Brahmbhatt, University of Pennsylvania
+// Compile with: g++ code4-5.cpp -o code4-5 `pkg-config --cflags --libs opencv` -lboost_thread -lboost_system
 
 #include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
 
 using namespace cv;
 using namespace std;
 
-int main()
+// Class that encodes frames to a VideoWriter on its own thread
+class asyncWriter {
+	public:
+		// what to do when a frame arrives and the queue is full
+		enum policy {
+			BLOCK, // wait for the encoder, capture slows down but no frame is lost
+			DROP_OLDEST, // throw away the oldest queued frame to make room
+			DROP_NEWEST // throw away the incoming frame
+		};
+	private:
+		VideoWriter *put;
+		policy pol;
+		vector<Mat> slots; // queued frames, buffers are swapped in and out and never reallocated
+		Mat staging, working; // capture side copy and encoder side frame
+		int head, count;
+		bool done;
+		boost::mutex mtx;
+		boost::condition_variable not_empty, not_full;
+		boost::thread encoder;
+
+		// statistics
+		unsigned long written, dropped;
+		double latency_sum, latency_max; // encoder latency in ms
+
+		void run(); // function run by the encoder thread
+	public:
+		asyncWriter(VideoWriter *_put, int queue_size, policy _pol) { // constructor
+			put = _put;
+			pol = _pol;
+			slots.resize(queue_size);
+			head = count = 0;
+			done = false;
+			written = dropped = 0;
+			latency_sum = latency_max = 0;
+			encoder = boost::thread(&asyncWriter::run, this);
+		}
+
+		void push(const Mat &); // queue a frame for encoding according to the drop policy
+		void close(); // encode remaining frames and stop the encoder thread
+		void print_stats();
+};
+
+void asyncWriter::push(const Mat &frame) {
+	boost::unique_lock<boost::mutex> lock(mtx);
+	// a frame that will be thrown away is not copied
+	if(pol == DROP_NEWEST && count == int(slots.size())) {
+		dropped++;
+		return;
+	}
+	lock.unlock();
+
+	// copy outside the lock, staging keeps its buffer between frames
+	frame.copyTo(staging);
+
+	// only push() adds frames, so with DROP_NEWEST the queue still has room
+	lock.lock();
+	if(count == int(slots.size())) {
+		if(pol == DROP_OLDEST) {
+			head = (head + 1) % slots.size();
+			count--;
+			dropped++;
+		}
+		else {
+			while(count == int(slots.size())) not_full.wait(lock);
+		}
+	}
+	// exchange buffers with the free slot instead of copying pixels
+	std::swap(staging, slots[(head + count) % slots.size()]);
+	count++;
+	lock.unlock();
+	not_empty.notify_one();
+}
+
+void asyncWriter::run() {
+	while(true) {
+		boost::unique_lock<boost::mutex> lock(mtx);
+		while(count == 0 && !done) not_empty.wait(lock);
+		if(count == 0) break;
+		std::swap(working, slots[head]);
+		head = (head + 1) % slots.size();
+		count--;
+		lock.unlock();
+		not_full.notify_one();
+
+		double t0 = getTickCount();
+		*put << working;
+		double t = 1000 * (getTickCount() - t0) / getTickFrequency();
+
+		lock.lock();
+		written++;
+		latency_sum += t;
+		latency_max = max(latency_max, t);
+	}
+}
+
+void asyncWriter::close() {
+	{
+		boost::unique_lock<boost::mutex> lock(mtx);
+		done = true;
+	}
+	not_empty.notify_one();
+	encoder.join();
+}
+
+void asyncWriter::print_stats() {
+	boost::unique_lock<boost::mutex> lock(mtx);
+	cout << "Frames written: " << written << endl;
+	cout << "Frames dropped: " << dropped << endl;
+	cout << "Encoder latency: " << (written ? latency_sum / written : 0.) << " ms average, " << latency_max << " ms maximum" << endl;
+}
+
+int main(int argc, char **argv)
 {
+	// Run as ./code4-5 [block | drop-oldest | drop-newest] to choose what happens to frames when the encoder falls
+	// behind, drop-oldest by default
+	asyncWriter::policy pol = asyncWriter::DROP_OLDEST;
+	if(argc > 1) {
+		string p = argv[1];
+		if(p == "block") pol = asyncWriter::BLOCK;
+		else if(p == "drop-newest") pol = asyncWriter::DROP_NEWEST;
+		else if(p != "drop-oldest") {
+			cout << "Usage: " << argv[0] << " [block | drop-oldest | drop-newest]" << endl;
+			return -1;
+		}
+	}
+
 	// 0 is the ID of the built-in laptop camera, change if you want to use other camera
 	VideoCapture cap(0);
 	//check if the file was opened properly
@@ -19,7 +146,7 @@ int main()
 
 	// Get size of frames
 	Size S = Size((int) cap.get(CV_CAP_PROP_FRAME_WIDTH), (int) cap.get(CV_CAP_PROP_FRAME_HEIGHT));
-	
+
 	// Make a video writer object and initialize it
 	VideoWriter put("output.mpg", CV_FOURCC('M','P','E','G'), 30, S);
 	if(!put.isOpened())
@@ -29,10 +156,13 @@ int main()
 	}
 	namedWindow("Video");
 
+	// Encoder thread with a queue of 1 second of video
+	asyncWriter writer(&put, 30, pol);
+
 	// Play the video in a loop till it ends
+	Mat frame;
 	while(char(waitKey(1)) != 'q' && cap.isOpened())
 	{
-		Mat frame;
 		cap >> frame;
 		// Check if the video is over
 		if(frame.empty())
@@ -41,8 +171,11 @@ int main()
 			break;
 		}
 		imshow("Video", frame);
-		put << frame;
+		writer.push(frame);
 	}
 
+	writer.close();
+	writer.print_stats();
+
 	return 0;
 }
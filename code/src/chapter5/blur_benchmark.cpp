@@ -0,0 +1,75 @@
+// Program to benchmark blurCache against GaussianBlur() while scrubbing the kernel size slider of code5-2 up and
+// back down on a 20 MP image, with the kernel sizes and sigmas code5-2 uses.
+// Returns 1 if a cached blur differs from GaussianBlur() by more than 1 gray level on average or 3 at any pixel
+// Run as ./blur_benchmark [image], baboon.jpg by default. The image is tiled and cropped to 20 MP rather than resized, so
+// the blurs are compared on real detail
+// Compile with: g++ -O3 blur_benchmark.cpp -o blur_benchmark `pkg-config --cflags --libs opencv`
+
+#include <opencv2/opencv.hpp>
+#include <iomanip>
+#include "../include/blurCache.h"
+
+using namespace std;
+using namespace cv;
+
+int main(int argc, char **argv) {
+    string filename = argc > 1 ? argv[1] : "baboon.jpg";
+    Mat image = imread(filename);
+    if(image.empty()) {
+        cout << "Could not read " << filename << endl;
+        return -1;
+    }
+
+    // change if you want
+    Size size(5472, 3648);
+    int max_size = 21; // range of the slider
+    double max_mean_diff = 1, max_max_diff = 3;
+
+    Mat tiled;
+    repeat(image, (size.height + image.rows - 1) / image.rows, (size.width + image.cols - 1) / image.cols, tiled);
+    Mat img = tiled(Rect(0, 0, size.width, size.height)).clone();
+    blurCache blurs;
+    blurs.set_image(img);
+
+    cout << size.width << "x" << size.height << ", slider scrubbed from 1 to " << max_size << " and back" << endl;
+    cout << setw(8) << "kernel" << setw(16) << "GaussianBlur ms" << setw(14) << "cache up ms" << setw(16) << "cache down ms"
+         << setw(12) << "mean diff" << setw(10) << "max diff" << endl;
+
+    bool pass = true;
+    double worst_ref = 0, worst = 0;
+    vector<double> up(max_size + 1, 0);
+    // the slider moves one step at a time, as code5-2 rounds it to odd kernel sizes
+    for(int pass_no = 0; pass_no < 2; pass_no++) {
+        for(int step = 1; step <= max_size; step += 2) {
+            int k_size = pass_no == 0 ? step : max_size + 1 - step;
+            float sigma = 0.3 * ((k_size - 1) * 0.5 - 1) + 0.8;
+
+            double t0 = getTickCount();
+            const Mat &blurred = blurs.blur(k_size, sigma); // read only, held by the cache
+            double ms = 1000 * (getTickCount() - t0) / getTickFrequency();
+            worst = max(worst, ms);
+            if(pass_no == 0) {
+                up[k_size] = ms;
+                continue;
+            }
+
+            Mat ref;
+            t0 = getTickCount();
+            GaussianBlur(img, ref, Size(k_size, k_size), sigma);
+            double ref_ms = 1000 * (getTickCount() - t0) / getTickFrequency();
+            worst_ref = max(worst_ref, ref_ms);
+
+            Mat diff;
+            absdiff(blurred, ref, diff);
+            double max_diff, mean_diff = mean(diff.reshape(1))[0];
+            minMaxLoc(diff.reshape(1), 0, &max_diff);
+            bool fail = mean_diff > max_mean_diff || max_diff > max_max_diff;
+            if(fail) pass = false;
+            cout << setw(8) << k_size << setw(16) << ref_ms << setw(14) << up[k_size] << setw(16) << ms
+                 << setw(12) << mean_diff << setw(10) << max_diff << (fail ? "  FAIL" : "") << endl;
+        }
+    }
+    cout << "Slowest slider step: GaussianBlur " << worst_ref << " ms, blurCache " << worst << " ms" << endl;
+
+    return pass ? 0 : 1;
+}
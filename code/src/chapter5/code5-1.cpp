@@ -3,6 +3,7 @@
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "../include/kernelFilter.h"
 
 using namespace std;
 using namespace cv;
@@ -18,8 +19,9 @@ int main() {
 
     Mat filter_kernel = Mat(5, 5, CV_32FC1, vertical_fk);
 
-    // Apply filter 
-    filter2D(img, img_filtered, -1, filter_kernel);
+    // Apply filter. The kernel is a row times a column, so kernelFilter applies it as two 1D passes
+    kernelFilter filter(filter_kernel);
+    filter.apply(img, img_filtered);
 
     namedWindow("Image");
     namedWindow("Filtered image");
@@ -4,33 +4,35 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/blurCache.h"
 
 using namespace std;
 using namespace cv;
 
-Mat image, image_blurred;
+Mat image;
 int slider = 5;
 float sigma = 0.3 * ((slider - 1) * 0.5 - 1) + 0.8;
+blurCache blurs; // blurs of image already computed, reused when the slider comes back to them
 
 void on_trackbar(int, void *) {
     int k_size = max(1, slider);
     k_size = k_size % 2 == 0 ? k_size + 1 : k_size;
     setTrackbarPos("Kernel Size", "Blurred image", k_size);
     sigma = 0.3 * ((k_size - 1) * 0.5 - 1) + 0.8;
-    GaussianBlur(image, image_blurred, Size(k_size, k_size), sigma);
-    imshow("Blurred image", image_blurred);
+    // shown straight from the cache, which imshow() does not write to
+    imshow("Blurred image", blurs.blur(k_size, sigma));
 }
 
 int main() {
     image = imread("baboon.jpg");
+    blurs.set_image(image);
     
     namedWindow("Original image");
     namedWindow("Blurred image");
 
     imshow("Original image", image);
     sigma = 0.3 * ((slider - 1) * 0.5 - 1) + 0.8;
-    GaussianBlur(image, image_blurred, Size(slider, slider), sigma);
-    imshow("Blurred image", image_blurred);
+    imshow("Blurred image", blurs.blur(slider, sigma));
 
     createTrackbar("Kernel Size", "Blurred image", &slider, 21, on_trackbar);
 
@@ -4,6 +4,7 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/morphologyEngine.h"
 
 using namespace std;
 using namespace cv;
@@ -15,10 +16,10 @@ void process() {
     Mat st_elem = getStructuringElement(MORPH_RECT, Size(size_slider, size_slider));
 
     if(choice_slider == 0) {    
-        erode(image, image_processed, st_elem);
+        fast_erode(image, image_processed, st_elem);
     }
     else {
-        dilate(image, image_processed, st_elem);
+        fast_dilate(image, image_processed, st_elem);
     }
     imshow("Processed image", image_processed);
 }
@@ -42,7 +43,7 @@ int main() {
 
     imshow("Original image", image);
     Mat st_elem = getStructuringElement(MORPH_RECT, Size(size_slider, size_slider));
-    erode(image, image_processed, st_elem);
+    fast_erode(image, image_processed, st_elem);
     imshow("Processed image", image_processed);
 
     createTrackbar("Erode/Dilate", "Processed image", &choice_slider, 1, on_choice_slider);
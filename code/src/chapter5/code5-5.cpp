@@ -4,6 +4,7 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/gradientKernels.h"
 
 using namespace std;
 using namespace cv;
@@ -30,25 +31,13 @@ int main() {
     Mat image_gray;
     cvtColor(image_blurred, image_gray, CV_BGR2GRAY);
 
-    // Gradients in X and Y directions
-    Mat grad_x, grad_y;
-
-    Scharr(image_gray, grad_x, CV_32F, 1, 0);
-    Scharr(image_gray, grad_y, CV_32F, 0, 1);
-
-    // Calculate overall gradient
-    pow(grad_x, 2, grad_x);
-    pow(grad_y, 2, grad_y);
-
-    Mat grad = grad_x + grad_y;
-    sqrt(grad, grad);
+    // Magnitude of the gradients in X and Y directions, both computed in one pass and saturated to 8 bit depth
+    scharr_magnitude(image_gray, edges);
 
     // Display
     namedWindow("Original image");
     namedWindow("Thresholded Scharr edges");
 
-    // Convert to 8 bit depth for displaying
-    grad.convertTo(edges, CV_8U);
     threshold(edges, edges_thresholded, slider, 255, THRESH_TOZERO);
 
     imshow("Original image", image);
@@ -1,9 +1,11 @@
 // Program to display a video from attached default camera device and detect colored blobs using simple R G and B thresholding
 // Author: Samarth Manoj Brahmbhatt, University of Pennsylvania
+// Compile with: g++ code5-7.cpp -o code5-7 `pkg-config --cflags --libs opencv` -lboost_thread -lboost_system
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/headless.h"
 
 using namespace cv;
 using namespace std;
@@ -64,11 +66,15 @@ void on_high_thresh_trackbar(int, void *) {
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
+	// Run with --headless <file> to benchmark without a display
+	headlessRunner hr(argc, argv);
+
 	// Create a VideoCapture object to read from video file
 	// 0 is the ID of the built-in laptop camera, change if you want to use other camera
-	VideoCapture cap(0);
+	VideoCapture cap;
+	hr.open(cap, 0);
         cap.set(CV_CAP_PROP_FRAME_WIDTH, 320);
         cap.set(CV_CAP_PROP_FRAME_HEIGHT, 240);
 	
@@ -79,19 +85,25 @@ int main()
 		return -1;
 	}
 
-	namedWindow("Video");
-	namedWindow("Segmentation");
+        if(!hr.is_headless()) {
+                namedWindow("Video");
+                namedWindow("Segmentation");
+
+                createTrackbar("0. R\n1. G\n2.B", "Segmentation", &rgb_slider, 2, on_rgb_trackbar);
+                createTrackbar("Low threshold", "Segmentation", &low_slider, 255, on_low_thresh_trackbar);
+                createTrackbar("High threshold", "Segmentation", &high_slider, 255, on_high_thresh_trackbar);
+        }
 
-        createTrackbar("0. R\n1. G\n2.B", "Segmentation", &rgb_slider, 2, on_rgb_trackbar);
-        createTrackbar("Low threshold", "Segmentation", &low_slider, 255, on_low_thresh_trackbar);
-        createTrackbar("High threshold", "Segmentation", &high_slider, 255, on_high_thresh_trackbar);
+        // Per-stage timings and the frame rate are written to profile.csv every second
+        stageProfiler::instance().start_dump("profile.csv", 1);
 
-        double time = 0;
-        unsigned int frames = 0;
-	while(char(waitKey(1)) != 'q' && cap.isOpened())
+	// profiler ids of the stages, looked up once outside of the frame loop
+	const int capture_id = hr.stage_id("capture"), threshold_id = hr.stage_id("threshold"),
+		display_id = hr.stage_id("display");
+
+	while(hr.next() && cap.isOpened())
 	{
-                frames++;
-                double t0 = getTickCount();
+                hr.stage(capture_id);
 		cap >> frame;
 		// Check if the video is over
 		if(frame.empty())
@@ -100,13 +112,16 @@ int main()
 			break;
 		}
                 
+                hr.stage(threshold_id);
                 inRange(frame, Scalar(low_b, low_g, low_r), Scalar(high_b, high_g, high_r), frame_thresholded);
 		
-                imshow("Video", frame);
-                imshow("Segmentation", frame_thresholded);
-                time += (getTickCount() - t0) / getTickFrequency();
-                cout << frames / time << " fps" << endl;
+                hr.stage(display_id);
+                hr.show("Video", frame);
+                hr.show("Segmentation", frame_thresholded);
 	}
 
+        stageProfiler::instance().stop_dump();
+        hr.report();
+
 	return 0;
 }
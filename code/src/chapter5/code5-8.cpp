@@ -1,10 +1,13 @@
 // Program to display a video from attached default camera device and detect colored blobs using simple R G and B thresholding
 // Remove noise using opening and closing morphological operations
 // Author: Samarth Manoj Brahmbhatt, University of Pennsylvania
+// Compile with: g++ -O3 -msse2 code5-8.cpp -o code5-8 `pkg-config --cflags --libs opencv` -lboost_thread -lboost_system
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/headless.h"
+#include "../include/blobSegmenter.h"
 
 using namespace cv;
 using namespace std;
@@ -65,11 +68,15 @@ void on_high_thresh_trackbar(int, void *) {
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
+	// Run with --headless <file> to benchmark without a display
+	headlessRunner hr(argc, argv);
+
 	// Create a VideoCapture object to read from video file
 	// 0 is the ID of the built-in laptop camera, change if you want to use other camera
-	VideoCapture cap(0);
+	VideoCapture cap;
+	hr.open(cap, 0);
 	
 	//check if the file was opened properly
 	if(!cap.isOpened())
@@ -78,16 +85,25 @@ int main()
 		return -1;
 	}
 
-	namedWindow("Video");
-	namedWindow("Segmentation");
+        if(!hr.is_headless()) {
+                namedWindow("Video");
+                namedWindow("Segmentation");
 
-        createTrackbar("0. R\n1. G\n2.B", "Segmentation", &rgb_slider, 2, on_rgb_trackbar);
-        createTrackbar("Low threshold", "Segmentation", &low_slider, 255, on_low_thresh_trackbar);
-        createTrackbar("High threshold", "Segmentation", &high_slider, 255, on_high_thresh_trackbar);
+                createTrackbar("0. R\n1. G\n2.B", "Segmentation", &rgb_slider, 2, on_rgb_trackbar);
+                createTrackbar("Low threshold", "Segmentation", &low_slider, 255, on_low_thresh_trackbar);
+                createTrackbar("High threshold", "Segmentation", &high_slider, 255, on_high_thresh_trackbar);
+        }
 
+        // thresholds, opens and closes in one pass, with the structuring element decomposed once
+        blobSegmenter segmenter(getStructuringElement(MORPH_RECT, Size(3, 3)));
         
-	while(char(waitKey(1)) != 'q' && cap.isOpened())
+	// profiler ids of the stages, looked up once outside of the frame loop
+	const int capture_id = hr.stage_id("capture"), segmentation_id = hr.stage_id("segmentation"),
+		display_id = hr.stage_id("display");
+
+	while(hr.next() && cap.isOpened())
 	{
+                hr.stage(capture_id);
 		cap >> frame;
 		// Check if the video is over
 		if(frame.empty())
@@ -96,14 +112,15 @@ int main()
 			break;
 		}
                 
-                inRange(frame, Scalar(low_b, low_g, low_r), Scalar(high_b, high_g, high_r), frame_thresholded);
-                Mat str_el = getStructuringElement(MORPH_RECT, Size(3, 3));
-                morphologyEx(frame_thresholded, frame_thresholded, MORPH_OPEN, str_el);
-                morphologyEx(frame_thresholded, frame_thresholded, MORPH_CLOSE, str_el);
+                hr.stage(segmentation_id);
+                segmenter.segment(frame, Scalar(low_b, low_g, low_r), Scalar(high_b, high_g, high_r), frame_thresholded);
 		
-                imshow("Video", frame);
-                imshow("Segmentation", frame_thresholded);
+                hr.stage(display_id);
+                hr.show("Video", frame);
+                hr.show("Segmentation", frame_thresholded);
 	}
 
+        hr.report();
+
 	return 0;
 }
@@ -0,0 +1,93 @@
+// Program to benchmark the direct, separable and DFT paths of kernelFilter against filter2D() for kernel sizes from
+// 3 to 31, with kernels of rank 1 (Gaussian), rank 2 (sum of two Gaussians of different widths) and full rank
+// (random). Shows which path the cost model picks and which one was fastest.
+// Returns 1 if any path differs from filter2D() by more than 1 gray level
+// Run as ./filter_benchmark [image], image.jpg by default
+// Compile with: g++ -O3 filter_benchmark.cpp -o filter_benchmark `pkg-config --cflags --libs opencv`
+
+#include <opencv2/opencv.hpp>
+#include <iomanip>
+#include "../include/kernelFilter.h"
+
+using namespace std;
+using namespace cv;
+
+// Kernel of a size and rank (0 for full rank), summing to 1
+Mat make_kernel(int size, int rank, RNG &rng) {
+    Mat k;
+    if(rank == 0) {
+        k.create(size, size, CV_32F);
+        rng.fill(k, RNG::UNIFORM, Scalar::all(0), Scalar::all(1));
+    }
+    else {
+        k = Mat::zeros(size, size, CV_32F);
+        for(int r = 0; r < rank; r++) {
+            Mat g = getGaussianKernel(size, (r + 1) * size / 6., CV_32F);
+            k += g * g.t();
+        }
+    }
+    return k / sum(k)[0];
+}
+
+// Average ms of a filter path over a number of runs
+double time_path(kernelFilter &f, const Mat &img, Mat &out, int method, int runs) {
+    double t0 = getTickCount();
+    for(int i = 0; i < runs; i++) f.apply(img, out, -1, method);
+    return 1000 * (getTickCount() - t0) / getTickFrequency() / runs;
+}
+
+int main(int argc, char **argv) {
+    string filename = argc > 1 ? argv[1] : "image.jpg";
+    Mat image = imread(filename);
+    if(image.empty()) {
+        cout << "Could not read " << filename << endl;
+        return -1;
+    }
+
+    // change if you want
+    int runs = 5;
+    Size size(1280, 720);
+    int min_size = 3, max_size = 31;
+
+    Mat img;
+    resize(image, img, size);
+    RNG rng(1);
+    const char *kinds[] = {"full", "rank 1", "rank 2"};
+    const char *methods[] = {"direct", "separable", "DFT"};
+
+    cout << size.width << "x" << size.height << " 3 channels, " << runs << " runs each, times in ms" << endl;
+    cout << setw(8) << "kernel" << setw(6) << "size" << setw(6) << "rank" << setw(11) << "filter2D" << setw(11) << "direct"
+         << setw(11) << "separable" << setw(11) << "DFT" << setw(11) << "picked" << setw(11) << "fastest" << setw(10) << "max diff" << endl;
+
+    bool pass = true;
+    for(int kind = 0; kind < 3; kind++) {
+        for(int s = min_size; s <= max_size; s += 2) {
+            Mat k = make_kernel(s, kind, rng);
+            kernelFilter f(k);
+
+            Mat ref;
+            double t0 = getTickCount();
+            for(int i = 0; i < runs; i++) filter2D(img, ref, -1, k);
+            double ref_ms = 1000 * (getTickCount() - t0) / getTickFrequency() / runs;
+
+            double ms[3], max_diff = 0;
+            int fastest = 0;
+            for(int m = 0; m < 3; m++) {
+                Mat out, diff;
+                ms[m] = time_path(f, img, out, m, runs);
+                if(ms[m] < ms[fastest]) fastest = m;
+                absdiff(out, ref, diff);
+                double d;
+                minMaxLoc(diff.reshape(1), 0, &d);
+                max_diff = max(max_diff, d);
+            }
+            if(max_diff > 1) pass = false;
+
+            cout << setw(8) << kinds[kind] << setw(6) << s << setw(6) << f.get_rank() << setw(11) << ref_ms << setw(11) << ms[0]
+                 << setw(11) << ms[1] << setw(11) << ms[2] << setw(11) << methods[f.choose(size)] << setw(11) << methods[fastest]
+                 << setw(10) << max_diff << (max_diff > 1 ? "  FAIL" : "") << endl;
+        }
+    }
+
+    return pass ? 0 : 1;
+}
@@ -4,6 +4,8 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include <algorithm>
+#include <climits>
 
 using namespace std;
 using namespace cv;
@@ -13,7 +15,7 @@ vector<Vec4i> heirarchy;
 Mat img_all_contours;
 
 // Function to make the contours closed
-void make_contours_closed(vector<vector<Point> > contours) {
+void make_contours_closed(vector<vector<Point> > &contours) {
     for(int i = 0; i < contours.size(); i++) {
         vector<Point> cc;
         approxPolyDP(contours[i], cc, 0.1, true);
@@ -21,31 +23,150 @@ void make_contours_closed(vector<vector<Point> > contours) {
     }
 }
 
-// Function to find the index of smalledst enclosing contour in 'contours'
-int smallest_contour(Point p, vector<vector<Point> > contours, vector<Vec4i> heirarchy) {
-    int idx = 0, prev_idx = -1;
-    while(idx >= 0) {
-        vector<Point> c = contours[idx];
-        // Point polygon test
-        double d = pointPolygonTest(c, p, false);
-        // If point is inside the contour, move to its child... 
-        if(d > 0) {
-            prev_idx = idx;
-            idx = heirarchy[idx][2];
+// Index answering which is the smallest closed contour enclosing a point, built once after findContours().
+// The image is divided in cells, each listing the contours whose bounding box meets it, deepest in the hierarchy first.
+// Every contour keeps the x co-ordinates where its edges cross each of its rows, sorted, so a point is tested against
+// it by a binary search in one row instead of a walk along the whole contour
+class contourIndex {
+    private:
+        struct node {
+            Rect box; // bounding box
+            vector<int> row_start; // crossings of row box.y + r are xs[row_start[r]] to xs[row_start[r + 1] - 1]
+            vector<float> xs;
+            vector<int> edge_start; // pixels of row box.y + r on the contour are in the intervals on[edge_start[r]]
+            vector<Vec2i> on; // to on[edge_start[r + 1] - 1], sorted and merged
+        };
+        vector<node> nodes;
+        int cell; // side of the cells in pixels
+        Size grid; // number of cells
+        vector<vector<int> > cells; // contours whose bounding box meets each cell
+
+        int inside(int, Point) const; // 1 if the point is inside the contour, 0 if on it, -1 if outside
+    public:
+        contourIndex() {cell = 16;}
+
+        void build(const vector<vector<Point> > &, const vector<Vec4i> &, Size); // index the contours of an image
+        int smallest_contour(Point) const; // index of the smallest contour enclosing a point, -1 if none
+        void smallest_contours(const vector<Point> &, vector<int> &) const; // same for many points
+};
+
+// Orders intervals of x co-ordinates by their start
+struct lessInterval {
+    bool operator()(const Vec2i &a, const Vec2i &b) const {return a[0] < b[0] || (a[0] == b[0] && a[1] < b[1]);}
+};
+
+// Orders contours deepest first
+struct deeper {
+    const vector<int> *depth;
+    deeper(const vector<int> *_depth) {depth = _depth;}
+    bool operator()(int a, int b) const {return (*depth)[a] > (*depth)[b] || ((*depth)[a] == (*depth)[b] && a < b);}
+};
+
+void contourIndex::build(const vector<vector<Point> > &contours, const vector<Vec4i> &heirarchy, Size size) {
+    nodes.assign(contours.size(), node());
+    grid = Size((size.width + cell - 1) / cell, (size.height + cell - 1) / cell);
+    cells.assign(grid.area(), vector<int>());
+
+    // depth of every contour from the parent links of the hierarchy
+    vector<int> depth(contours.size(), -1);
+    for(int i = 0; i < contours.size(); i++) {
+        int d = 0;
+        for(int j = heirarchy[i][3]; j >= 0; j = heirarchy[j][3]) d++;
+        depth[i] = d;
+    }
+
+    for(int i = 0; i < contours.size(); i++) {
+        const vector<Point> &c = contours[i];
+        node &n = nodes[i];
+        if(c.empty()) continue;
+        n.box = boundingRect(c);
+        int h = n.box.height;
+
+        // crossings of every row by the edges of the contour, taken as closed. An edge crosses row y if its ends are
+        // on different sides of it counting y as below, so that vertices are counted once
+        vector<vector<float> > rows(h);
+        vector<vector<Vec2i> > on(h);
+        for(int k = 0; k < c.size(); k++) {
+            Point p0 = c[k], p1 = c[(k + 1) % c.size()];
+            int y_min = min(p0.y, p1.y), y_max = max(p0.y, p1.y);
+            for(int y = y_min; y <= y_max; y++) {
+                int r = y - n.box.y;
+                if(p0.y == p1.y) {
+                    on[r].push_back(Vec2i(min(p0.x, p1.x), max(p0.x, p1.x)));
+                    continue;
+                }
+                // pixel of the row on the edge, if there is one
+                int num = (y - p0.y) * (p1.x - p0.x), den = p1.y - p0.y;
+                if(num % den == 0) on[r].push_back(Vec2i(p0.x + num / den, p0.x + num / den));
+                if((p0.y > y) != (p1.y > y)) rows[r].push_back(p0.x + float(num) / den);
+            }
+        }
+
+        n.row_start.resize(h + 1);
+        n.edge_start.resize(h + 1);
+        n.row_start[0] = n.edge_start[0] = 0;
+        for(int r = 0; r < h; r++) {
+            sort(rows[r].begin(), rows[r].end());
+            n.xs.insert(n.xs.end(), rows[r].begin(), rows[r].end());
+            n.row_start[r + 1] = n.xs.size();
+
+            sort(on[r].begin(), on[r].end(), lessInterval());
+            for(int k = 0; k < on[r].size(); k++) {
+                if(n.on.size() > n.edge_start[r] && on[r][k][0] <= n.on.back()[1] + 1) n.on.back()[1] = max(n.on.back()[1], on[r][k][1]);
+                else n.on.push_back(on[r][k]);
+            }
+            n.edge_start[r + 1] = n.on.size();
         }
-        //...else check the next cotour at the same level
-        else idx = heirarchy[idx][0];
+
+        // list the contour in the cells its bounding box meets
+        Rect cell_box(n.box.x / cell, n.box.y / cell, (n.box.x + n.box.width - 1) / cell - n.box.x / cell + 1,
+                      (n.box.y + n.box.height - 1) / cell - n.box.y / cell + 1);
+        cell_box &= Rect(0, 0, grid.width, grid.height);
+        for(int y = cell_box.y; y < cell_box.y + cell_box.height; y++)
+            for(int x = cell_box.x; x < cell_box.x + cell_box.width; x++) cells[y * grid.width + x].push_back(i);
     }
 
-    return prev_idx;
+    for(int k = 0; k < cells.size(); k++) sort(cells[k].begin(), cells[k].end(), deeper(&depth));
+}
+
+int contourIndex::inside(int i, Point p) const {
+    const node &n = nodes[i];
+    if(!n.box.contains(p)) return -1;
+    int r = p.y - n.box.y;
+
+    // on the contour: the last interval starting at or before p.x must reach it
+    const Vec2i *on_begin = n.on.empty() ? 0 : &n.on[0] + n.edge_start[r], *on_end = n.on.empty() ? 0 : &n.on[0] + n.edge_start[r + 1];
+    const Vec2i *it = upper_bound(on_begin, on_end, Vec2i(p.x, INT_MAX), lessInterval());
+    if(it != on_begin && (it - 1)->val[1] >= p.x) return 0;
+
+    // inside if an odd number of edges cross the row to the right of the point
+    const float *xs_begin = n.xs.empty() ? 0 : &n.xs[0] + n.row_start[r], *xs_end = n.xs.empty() ? 0 : &n.xs[0] + n.row_start[r + 1];
+    int right = xs_end - upper_bound(xs_begin, xs_end, float(p.x));
+    return right % 2 ? 1 : -1;
+}
+
+int contourIndex::smallest_contour(Point p) const {
+    if(p.x < 0 || p.y < 0 || p.x >= grid.width * cell || p.y >= grid.height * cell) return -1;
+    // contours are nested, so the deepest one enclosing the point is the smallest
+    const vector<int> &candidates = cells[(p.y / cell) * grid.width + p.x / cell];
+    for(int k = 0; k < candidates.size(); k++)
+        if(inside(candidates[k], p) > 0) return candidates[k];
+    return -1;
 }
 
+void contourIndex::smallest_contours(const vector<Point> &points, vector<int> &idx) const {
+    idx.resize(points.size());
+    for(int i = 0; i < points.size(); i++) idx[i] = smallest_contour(points[i]);
+}
+
+contourIndex contour_index;
+
 // Mouse callback
 void on_mouse(int event, int x, int y, int, void *) {
     if(event != EVENT_LBUTTONDOWN) return;
     Point p(x, y);
 
-    int idx = smallest_contour(p, contours, heirarchy);
+    int idx = contour_index.smallest_contour(p);
     
     // If function returned a valid contour index, draw it using a thick red line
     if(idx > 0) {
@@ -65,6 +186,8 @@ int main() {
     findContours(edges, contours, heirarchy, CV_RETR_TREE, CV_CHAIN_APPROX_NONE);
     // Make the contours closed
     make_contours_closed(contours);
+    // Index the contours once, every click is answered from the index
+    contour_index.build(contours, heirarchy, img.size());
     img_all_contours = img.clone();
     // Draw all contours using a thin green line
     drawContours(img_all_contours, contours, -1, Scalar(0, 255, 0));
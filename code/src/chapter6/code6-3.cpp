@@ -4,6 +4,7 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/houghEngine.h"
 
 using namespace std;
 using namespace cv;
@@ -11,14 +12,13 @@ using namespace cv;
 Mat img;
 int shape = 0; //0 -> lines, 1 -> circles
 int thresh = 100; // Accumulator threshold
+houghEngine hough; // keeps the edges and accumulators of img, so moving the threshold only rescans them
 
 void on_trackbar(int, void *) { // Circles
     if(shape == 1) {
-        Mat img_gray;
-        cvtColor(img, img_gray, CV_BGR2GRAY);
         // Find circles
         vector<Vec3f> circles;
-        HoughCircles(img_gray, circles, CV_HOUGH_GRADIENT, 1, 10, 200, thresh > 0 ? thresh : 1, 5);
+        hough.circles(circles, thresh > 0 ? thresh : 1, 1, 10, 200, 5);
         // Draw circles
         Mat img_show = img.clone();
         for(int i = 0; i < circles.size(); i++) {
@@ -32,11 +32,9 @@ void on_trackbar(int, void *) { // Circles
         imshow("Shapes", img_show);
     }
     else if(shape == 0) { // Lines
-        Mat edges;
-        Canny(img, edges, 50, 100);
         // Find lines
         vector<Vec2f> lines;
-        HoughLines(edges, lines, 1, CV_PI/180.f, thresh);
+        hough.lines(lines, thresh, 1, CV_PI/180.f, 50, 100);
         // Draw lines
         Mat img_show = img.clone();
         for(int i = 0; i < lines.size(); i++) {
@@ -55,6 +53,7 @@ void on_trackbar(int, void *) { // Circles
 int main() {
     //img = imread("hough.jpg");
     img = imread("fruit.jpg");
+    hough.set_image(img);
 
     namedWindow("Shapes");
 
@@ -1,13 +1,16 @@
 // Program to find the largest ellipse using RANSAC
 // Author: Samarth Manoj Brahmbhatt, University of Pennsylvania
+// Compile with: g++ -O3 code6-4.cpp -o code6-4 -I/usr/include/eigen3 `pkg-config --cflags --libs opencv` -lboost_thread -lboost_system -lboost_filesystem
 
 #include <Eigen/Dense>
-#include <opencv2/core/eigen.hpp>
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <algorithm>
 #include <math.h>
+#include "../include/ellipseKernels.h"
+#include "../include/ellipseRANSAC.h"
+#include "../include/ellipseBatch.h"
 
 #define PI 3.14159265
 
@@ -15,82 +18,42 @@ using namespace std;
 using namespace cv;
 using namespace Eigen;
 
-// Class to hold RANSAC parameters
-class RANSACparams {
-    private:
-        //number of iterations 
-        int iter;
-        //minimum number of inliers to further process a model
-        int min_inliers;
-        //distance threshold to be conted as inlier
-        float dist_thresh;
-        //number of points to select randomly at each iteration
-        int N;
-    public:
-        RANSACparams(int _iter, int _min_inliers, float _dist_thresh, int _N) { //constructor
-            iter = _iter;
-            min_inliers = _min_inliers;
-            dist_thresh = _dist_thresh;
-            N = _N;
-        }
-
-        int get_iter() {return iter;}
-        int get_min_inliers() {return min_inliers;}
-        float get_dist_thresh() {return dist_thresh;}
-        int get_N() {return N;}
-};
-
 // Class that deals with fitting an ellipse, RANSAC and drawing the ellipse in the image
 class ellipseFinder {
     private:
         Mat img; // input image
         vector<vector<Point> > contours; // contours in image
         Mat Q; // Matrix representing conic section of detected ellipse
+        int inliers; // inliers of the last ellipse found, 0 if none was found
+        int canny_l, canny_h; // Canny thresholds
+        bool tracker, tracked; // tracking a video, and the last frame was tracked near the previous ellipse
+        bool verbose; // print the number of contours and show the inliers
+        Mat prior; // conic tested as the first hypothesis of every task, empty if none
+        void find_contours(Rect); // function to extract contours from a region of the image
         Mat fit_ellipse(vector<Point>); // function to fit ellipse to a contour
-        Mat RANSACellipse(vector<vector<Point> >); // function to find ellipse in contours using RANSAC
+        Mat RANSACellipse(const vector<vector<Point> > &); // function to find ellipse in contours using RANSAC
         bool is_good_ellipse(Mat); // function that determines whether given conic section represents a valid ellipse
-        vector<vector<Point> > choose_random(vector<Point>); //function to choose points at random from contour
         vector<float> distance(Mat, vector<Point>); //function to return distance of points from the ellipse
         float distance(Mat, Point); //overloaded function to return signed distance of point from ellipse 
         void draw_ellipse(Mat); //function to draw ellipse in an image
         vector<Point> ellipse_contour(Mat); //function to convert equation of ellipse to a contour of points 
         void draw_inliers(Mat, vector<Point>); //function to debug inliers
 
-        // RANSAC parameters
-        int iter, min_inliers, N;
-        float dist_thresh;
+        ellipseRANSAC ransac; // parallel RANSAC search, see ellipseRANSAC.h
+        float dist_thresh; // distance threshold of the search, to draw its inliers
 
     public:
-        ellipseFinder(Mat _img, int l_canny, int h_canny, RANSACparams rp) { // constructor
+        ellipseFinder(Mat _img, int l_canny, int h_canny, RANSACparams rp, bool _verbose = true) : ransac(rp) { // constructor
             img = _img.clone();
-            Mat img_b;
-            GaussianBlur(img, img_b, Size(7, 7), 0);
-
-            // Edge detection and contour extraction
-            Mat edges; Canny(img_b, edges, l_canny, h_canny);
-            vector<vector<Point> > c;
-            findContours(edges, c, CV_RETR_LIST, CV_CHAIN_APPROX_NONE);
-            // Remove small spurious short contours
-            for(int i = 0; i < c.size(); i++) {
-                bool is_closed = false;
-                
-                vector<Point> _c = c[i];
-                
-                Point p1 = _c.front(), p2 = _c.back();
-                float d = sqrt((p1.x - p2.x)^2 + (p1.y - p2.y)^2);
-                if(d <= 0.5) is_closed = true;
-
-                d = arcLength(_c, is_closed);
-
-                if(d > 50) contours.push_back(_c);
-            }
-
-            iter = rp.get_iter();
-            min_inliers = rp.get_min_inliers();
-            N = rp.get_N();
+            verbose = _verbose;
+            canny_l = l_canny;
+            canny_h = h_canny;
+            find_contours(Rect(0, 0, img.cols, img.rows));
             dist_thresh = rp.get_dist_thresh();
 
             Q = Mat::eye(6, 1, CV_32F);
+            inliers = 0;
+            tracker = tracked = false;
 
             /*
             //for debug
@@ -99,43 +62,49 @@ class ellipseFinder {
             imshow("Contours", img_show);
             //imshow("Edges", edges);
             */
-            cout << "No. of Contours = " << contours.size() << endl;
+            if(verbose) cout << "No. of Contours = " << contours.size() << endl;
         }
 
         void detect_ellipse(); //final wrapper function
+        bool find_ellipse(); //find the ellipse without showing it, false if there is none
+        Mat get_ellipse() {return Q;} //conic of the last ellipse found
+        int get_inliers() {return inliers;} //inliers of the last ellipse found, 0 if none was found
         void debug(); //debug function
+        RANSACstats get_stats() {return ransac.get_stats();} //work done by the last search
+        bool track(Mat); //find the ellipse in the next frame of a video, near the ellipse of the previous frame
+        bool is_tracked() {return tracked;} //whether the last frame was tracked without a search of the whole frame
+        void show_ellipse(); //show the last ellipse found
 };
 
+void ellipseFinder::find_contours(Rect roi) {
+    Mat img_b;
+    GaussianBlur(img(roi), img_b, Size(7, 7), 0);
+
+    // Edge detection and contour extraction, contour points are in image co-ordinates
+    Mat edges; Canny(img_b, edges, canny_l, canny_h);
+    vector<vector<Point> > c;
+    findContours(edges, c, CV_RETR_LIST, CV_CHAIN_APPROX_NONE, roi.tl());
+    // Remove small spurious short contours
+    contours.clear();
+    keep_long_contours(c, contours);
+}
+
 vector<float> ellipseFinder::distance(Mat Q, vector<Point> c) {
-    vector<Point> ellipse = ellipse_contour(Q);
-    vector<float> distances;
-    for(int i = 0; i < c.size(); i++) {
-        distances.push_back(float(pointPolygonTest(ellipse, c[i], true)));
-    }
+    // Sampson distance computed from the conic coefficients, see ellipseKernels.h
+    float q[6];
+    conic_coeffs(Q, q);
+    pointsSoA pts(c);
+    vector<float> distances(c.size());
+    if(!c.empty()) conic_distance(q, &pts.x[0], &pts.y[0], pts.size(), &distances[0]);
 
     return distances;
 }
 
 float ellipseFinder::distance(Mat Q, Point p) {
-    vector<Point> ellipse = ellipse_contour(Q);
-    return float(pointPolygonTest(ellipse, p, true));
-}
-
-vector<vector<Point> > ellipseFinder::choose_random(vector<Point> c) {
-    vector<vector<Point> > cr;
-    vector<Point> cr0, cr1;
-    // Randomly shuffle all elements of contour 
-    std::random_shuffle(c.begin(), c.end());
-    // Put the first N elements into cr[0] as consensus set (see Wikipedia RANSAC algorithm) and
-    // the rest in cr[1] to check for inliers
-    for(int i = 0; i < c.size(); i++) {
-        if(i < N) cr0.push_back(c[i]);
-        else cr1.push_back(c[i]);
-    }
-    cr.push_back(cr0);
-    cr.push_back(cr1);
-
-    return cr;    
+    float q[6], x = p.x, y = p.y, d;
+    conic_coeffs(Q, q);
+    conic_distance(q, &x, &y, 1, &d);
+    return d;
 }
 
 Mat ellipseFinder::fit_ellipse(vector<Point> c) {
@@ -147,109 +116,23 @@ Mat ellipseFinder::fit_ellipse(vector<Point> c) {
     drawContours(img_show, cr, -1, Scalar(0, 0, 255), 2);
     imshow("Debug fitEllipse", img_show);
     */
-    int N = c.size();
-    
-    Mat D;
-    for(int i = 0; i < N; i++) {
-        Point p = c[i];
-        Mat r(1, 6, CV_32FC1);
-        r = (Mat_<float>(1, 6) << (p.x)*(p.x), (p.x)*(p.y), (p.y)*(p.y), p.x, p.y, 1.f);
-        D.push_back(r);
-    }
-    Mat S = D.t() * D, _S;
-
-    double d = invert(S, _S);
-    //if(d < 0.001) cout << "S matrix is singular" << endl;
-
-    Mat C = Mat::zeros(6, 6, CV_32F);
-    C.at<float>(2, 0) = 2;
-    C.at<float>(1, 1) = -1;
-    C.at<float>(0, 2) = 2;
-
-    // Using EIGEN to calculate eigenvalues and eigenvectors
-    Mat prod = _S * C;
-    Eigen::MatrixXd prod_e;
-    cv2eigen(prod, prod_e);
-    EigenSolver<Eigen::MatrixXd> es(prod_e);
-
-    Mat evec, eval, vec(6, 6, CV_32FC1), val(6, 1, CV_32FC1);
-
-    eigen2cv(es.eigenvectors(), evec);
-    eigen2cv(es.eigenvalues(), eval);
+    // Direct least squares fit with fixed size matrices, see ellipseKernels.h
+    // A conic of zeros is returned if the points do not determine an ellipse, is_good_ellipse() rejects it
+    Mat Q = Mat::zeros(6, 1, CV_32F);
+    if(!c.empty()) fit_conic(&c[0], c.size(), (float *)Q.data);
 
-    evec.convertTo(evec, CV_32F);
-    eval.convertTo(eval, CV_32F);
-
-    // Eigen returns complex parts in the second channel (which are all 0 here) so select just the first channel
-    int from_to[] = {0, 0};
-    mixChannels(&evec, 1, &vec, 1, from_to, 1);
-    mixChannels(&eval, 1, &val, 1, from_to, 1);
-
-    Point maxLoc;
-    minMaxLoc(val, NULL, NULL, NULL, &maxLoc);
-        
-    return vec.col(maxLoc.y);
+    return Q;
 }
 
 bool ellipseFinder::is_good_ellipse(Mat Q) {
-    float a = Q.at<float>(0, 0),
-          b = (Q.at<float>(1, 0))/2,
-          c = Q.at<float>(2, 0),
-          d = (Q.at<float>(3, 0))/2,
-          f = (Q.at<float>(4, 0))/2,
-          g = Q.at<float>(5, 0);
-
-    if(b*b - a*c == 0) return false;
-
-    float thresh = 0.09,
-        num = 2 * (a*f*f + c*d*d + g*b*b - 2*b*d*f - a*c*g),
-        den1 = (b*b - a*c) * (sqrt((a-c)*(a-c) + 4*b*b) - (a + c)),
-        den2 = (b*b - a*c) * (-sqrt((a-c)*(a-c) + 4*b*b) - (a + c)),
-        a_len = sqrt(num / den1),
-        b_len = sqrt(num / den2),
-        major_axis = max(a_len, b_len),
-        minor_axis = min(a_len, b_len);
-
-    if(minor_axis < thresh*major_axis || num/den1 < 0.f || num/den2 < 0.f || major_axis > max(img.rows, img.cols)) return false;
-    else return true;
+    return is_good_conic((float *)Q.data, max(img.rows, img.cols));
 }
 
-Mat ellipseFinder::RANSACellipse(vector<vector<Point> > contours) {
-    int best_overall_inlier_score = 0;
+Mat ellipseFinder::RANSACellipse(const vector<vector<Point> > &contours) {
     Mat Q_best = 777 * Mat::ones(6, 1, CV_32FC1);
-    int idx_best = -1;
-
-    //for each contour...
-    for(int i = 0; i < contours.size(); i++) {
-        vector<Point> c = contours[i];
-        if(c.size() < min_inliers) continue;
-        
-        Mat Q;
-        int best_inlier_score = 0;
-        for(int j = 0; j < iter; j++) {
-            // ...choose points at random...
-            vector<vector<Point> > cr = choose_random(c);
-            vector<Point> consensus_set = cr[0], rest = cr[1];
-            // ...fit ellipse to those points...
-            Mat Q_maybe = fit_ellipse(consensus_set);
-            // ...check for inliers...
-            vector<float> d = distance(Q_maybe, rest);
-            for(int k = 0; k < d.size(); k++)
-                if(abs(d[k]) < dist_thresh) consensus_set.push_back(rest[k]);
-            // ...and find the random set with the most number of inliers
-            if(consensus_set.size() > min_inliers && consensus_set.size() > best_inlier_score) {
-                Q = fit_ellipse(consensus_set);
-                best_inlier_score = consensus_set.size();
-            }
-        }
-        // find cotour with ellipse that has the most number of inliers
-        if(best_inlier_score > best_overall_inlier_score && is_good_ellipse(Q)) {
-            best_overall_inlier_score = best_inlier_score;
-            Q_best = Q.clone();
-            if(Q_best.at<float>(5, 0) < 0) Q_best *= -1.f;
-            idx_best = i;
-        }
-    }
+
+    // hypotheses of all contours tried in parallel, see ellipseRANSAC.h
+    int idx_best = ransac.search(contours, max(img.rows, img.cols), (float *)Q_best.data, prior);
     
     /*
     //for debug
@@ -257,9 +140,10 @@ Mat ellipseFinder::RANSACellipse(vector<vector<Point> > contours) {
     drawContours(img_show, contours, idx_best, Scalar(0, 0, 255), 2);
     imshow("Best Contour", img_show);
 
-    cout << "inliers " << best_overall_inlier_score << endl;
+    cout << "inliers " << ransac.get_inliers() << endl;
     */
-    if(idx_best >= 0) draw_inliers(Q_best, contours[idx_best]);
+    if(idx_best >= 0 && verbose && !tracker) draw_inliers(Q_best, contours[idx_best]);
+    inliers = ransac.get_inliers();
     return Q_best;
 }
 
@@ -307,9 +191,51 @@ vector<Point> ellipseFinder::ellipse_contour(Mat Q) {
     return ellipse;
 }
 
-void ellipseFinder::detect_ellipse() {
+bool ellipseFinder::track(Mat frame) {
+    img = frame;
+    tracker = true;
+    if(inliers > 0) {
+        // Search only a region around the last ellipse, with the last ellipse as the first hypothesis. It usually
+        // has most of the inliers already, so with --adaptive the search stops after a few hypotheses
+        float margin = 0.25; // of the size of the ellipse, on each side
+        Rect box = boundingRect(ellipse_contour(Q));
+        int mx = margin * box.width + 8, my = margin * box.height + 8;
+        Rect roi = Rect(box.x - mx, box.y - my, box.width + 2 * mx, box.height + 2 * my) & Rect(0, 0, img.cols, img.rows);
+        if(roi.area() > 0) {
+            find_contours(roi);
+            prior = Q;
+            Mat Q_new = RANSACellipse(contours);
+            prior = Mat();
+            if(inliers > 0) {
+                Q = Q_new;
+                tracked = true;
+                return true;
+            }
+        }
+    }
+
+    // Lost track (or first frame): search the whole frame
+    tracked = false;
+    find_contours(Rect(0, 0, img.cols, img.rows));
+    Mat Q_new = RANSACellipse(contours);
+    if(inliers > 0) Q = Q_new;
+    return inliers > 0;
+}
+
+void ellipseFinder::show_ellipse() {
+    if(inliers > 0) draw_ellipse(Q);
+    else imshow("Ellipse", img);
+}
+
+bool ellipseFinder::find_ellipse() {
     Q = RANSACellipse(contours);
+    return inliers > 0;
+}
+
+void ellipseFinder::detect_ellipse() {
+    find_ellipse();
     cout << "Q" << Q << endl;
+    ransac.print_stats();
     draw_ellipse(Q);
 }
 
@@ -343,11 +269,10 @@ void ellipseFinder::draw_inliers(Mat Q, vector<Point> c) {
     // draw ellipse in thin blue
     drawContours(img_show, cs, 0, Scalar(255, 0, 0), 3);
     int count = 0;
+    vector<float> d = distance(Q, c);
     // draw inliers as green points
     for(int i = 0; i < c.size(); i++) {
-        double d = pointPolygonTest(ellipse, c[i], true);
-        float d1 = float(d);
-        if(abs(d1) < dist_thresh) {
+        if(abs(d[i]) < dist_thresh) {
             circle(img_show, c[i], 3, Scalar(0, 255, 0), -1);
             count ++;
         }
@@ -356,15 +281,60 @@ void ellipseFinder::draw_inliers(Mat Q, vector<Point> c) {
     cout << "inliers " << count << endl;
 }
     
-int main() {
-    Mat img = imread("eye.jpg");
+// Track the ellipse through a video, printing the time taken per frame
+int track_video(string filename, RANSACparams rp, int canny_l, int canny_h) {
+    VideoCapture cap(filename);
+    Mat frame;
+    cap >> frame;
+    if(frame.empty()) {
+        cout << "Could not read " << filename << endl;
+        return -1;
+    }
     namedWindow("Ellipse");
 
+    ellipseFinder ef(frame, canny_l, canny_h, rp);
+    int frames = 0, found = 0, tracked = 0;
+    double total_ms = 0, max_ms = 0;
+    for(; !frame.empty(); cap >> frame) {
+        double t0 = getTickCount();
+        found += ef.track(frame);
+        double ms = 1000 * (getTickCount() - t0) / getTickFrequency();
+        frames++;
+        tracked += ef.is_tracked();
+        total_ms += ms;
+        max_ms = max(max_ms, ms);
+
+        ef.show_ellipse();
+        if(char(waitKey(1)) == 'q') break;
+    }
+
+    cout << frames << " frames, " << total_ms / frames << " ms per frame on average, " << max_ms << " ms at most" << endl;
+    cout << "Ellipse found in " << found << " frames, " << tracked << " of them without searching the whole frame" << endl;
+    return 0;
+}
+
+int main(int argc, char **argv) {
     // object holding RANSAC parameters, initialized using the constructor
     RANSACparams rp(400, 100, 1, 5);
+    // Run with --adaptive before the other arguments for adaptive termination with 99% confidence and a pre-test on
+    // 1 point, instead of trying all the hypotheses
+    if(argc > 1 && string(argv[1]) == "--adaptive") {
+        rp.set_adaptive(true, 0.99, 1);
+        argc--;
+        argv++;
+    }
 
     // Canny thresholds
     int canny_l = 50, canny_h = 150;
+
+    // Run as ./code6-4 --batch <directory or video file> [output .csv or .json] to find the ellipse in every image
+    if(argc > 2 && string(argv[1]) == "--batch") return run_batch<ellipseFinder>(argv[2], argc > 3 ? argv[3] : "ellipses.csv", rp, canny_l, canny_h);
+    // Run as ./code6-4 <video file> to track the ellipse through a video
+    if(argc > 1) return track_video(argv[1], rp, canny_l, canny_h);
+
+    Mat img = imread("eye.jpg");
+    namedWindow("Ellipse");
+
     // Ellipse finder object, initialized using the constructor
     ellipseFinder ef(img, canny_l, canny_h, rp);
     ef.detect_ellipse();
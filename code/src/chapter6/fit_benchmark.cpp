@@ -0,0 +1,108 @@
+// Program to benchmark the fixed size ellipse fitting kernel against the Mat based fit it replaced in code6-4/code6-5
+// and to show that it makes no heap allocations: every operator new is counted, and Eigen is told to abort on any
+// heap allocation while the kernel runs
+// Compile with: g++ -O3 fit_benchmark.cpp -o fit_benchmark -I/usr/include/eigen3 `pkg-config --cflags --libs opencv`
+
+#define EIGEN_RUNTIME_NO_MALLOC
+#include <Eigen/Dense>
+#include <opencv2/core/eigen.hpp>
+#include <opencv2/opencv.hpp>
+#include "../include/ellipseKernels.h"
+#include "../include/allocCounter.h"
+
+using namespace std;
+using namespace cv;
+using namespace Eigen;
+
+// The fit used by code6-4/code6-5 before: design matrix built row by row, inverse of the scatter matrix, general EigenSolver
+Mat fit_mat(const vector<Point> &c) {
+    Mat D;
+    for(int i = 0; i < c.size(); i++) {
+        Point p = c[i];
+        Mat r = (Mat_<float>(1, 6) << (p.x)*(p.x), (p.x)*(p.y), (p.y)*(p.y), p.x, p.y, 1.f);
+        D.push_back(r);
+    }
+    Mat S = D.t() * D, _S;
+    invert(S, _S);
+
+    Mat C = Mat::zeros(6, 6, CV_32F);
+    C.at<float>(2, 0) = 2;
+    C.at<float>(1, 1) = -1;
+    C.at<float>(0, 2) = 2;
+
+    Mat prod = _S * C;
+    Eigen::MatrixXd prod_e;
+    cv2eigen(prod, prod_e);
+    EigenSolver<Eigen::MatrixXd> es(prod_e);
+
+    Mat evec, eval, vec(6, 6, CV_32FC1), val(6, 1, CV_32FC1);
+    eigen2cv(es.eigenvectors(), evec);
+    eigen2cv(es.eigenvalues(), eval);
+    evec.convertTo(evec, CV_32F);
+    eval.convertTo(eval, CV_32F);
+    int from_to[] = {0, 0};
+    mixChannels(&evec, 1, &vec, 1, from_to, 1);
+    mixChannels(&eval, 1, &val, 1, from_to, 1);
+
+    Point maxLoc;
+    minMaxLoc(val, NULL, NULL, NULL, &maxLoc);
+    return vec.col(maxLoc.y).clone();
+}
+
+int main() {
+    // Points of an ellipse (centre (320, 240), half axes 150 and 80, rotated by 30 degrees) with 1 px of noise
+    RNG rng(1);
+    vector<Point> ellipse_pts;
+    for(int i = 0; i < 400; i++) {
+        double t = 2 * CV_PI * i / 400, ca = cos(CV_PI / 6), sa = sin(CV_PI / 6);
+        double ex = 150 * cos(t), ey = 80 * sin(t);
+        ellipse_pts.push_back(Point(cvRound(320 + ca * ex - sa * ey + rng.uniform(-1., 1.)), cvRound(240 + sa * ex + ca * ey + rng.uniform(-1., 1.))));
+    }
+
+    // change if you want
+    int runs = 20000;
+    int sizes[] = {5, 50, 400}; // 5 is the RANSAC sample, the others are refits to inliers
+
+    for(int s = 0; s < 3; s++) {
+        vector<Point> c;
+        for(int i = 0; i < sizes[s]; i++) c.push_back(ellipse_pts[i * ellipse_pts.size() / sizes[s]]);
+        pointsSoA pts(c);
+        vector<unsigned char> inlier(ellipse_pts.size());
+        pointsSoA all(ellipse_pts);
+
+        // fixed size kernel, with Eigen heap allocations turned into an assertion
+        float q[6];
+        unsigned long a0 = allocations;
+        Eigen::internal::set_is_malloc_allowed(false);
+        double t0 = getTickCount();
+        bool ok = true;
+        for(int r = 0; r < runs; r++) ok &= fit_conic(&pts.x[0], &pts.y[0], NULL, pts.size(), q);
+        double t_kernel = (getTickCount() - t0) / getTickFrequency();
+        Eigen::internal::set_is_malloc_allowed(true);
+        unsigned long kernel_allocs = allocations - a0;
+        int kernel_inliers = count_inliers(q, &all.x[0], &all.y[0], all.size(), 2, &inlier[0]);
+
+        // Mat based fit
+        a0 = allocations;
+        Mat Q;
+        t0 = getTickCount();
+        for(int r = 0; r < runs; r++) Q = fit_mat(c);
+        double t_mat = (getTickCount() - t0) / getTickFrequency();
+        unsigned long mat_allocs = allocations - a0;
+        float qm[6];
+        conic_coeffs(Q, qm);
+        int mat_inliers = count_inliers(qm, &all.x[0], &all.y[0], all.size(), 2, &inlier[0]);
+
+        cout << sizes[s] << " points:" << endl;
+        cout << "  kernel: " << 1e6 * t_kernel / runs << " us/fit, " << double(kernel_allocs) / runs << " allocations/fit, "
+             << kernel_inliers << "/" << all.size() << " inliers" << (ok ? "" : ", fit failed") << endl;
+        cout << "  Mat:    " << 1e6 * t_mat / runs << " us/fit, " << double(mat_allocs) / runs << " allocations/fit (operator new only), "
+             << mat_inliers << "/" << all.size() << " inliers" << endl;
+        if(kernel_allocs != 0) {
+            cout << "Kernel allocated memory" << endl;
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,92 @@
+// Program to benchmark the parallel Hough line transform of houghEngine against HoughLines() as code6-3 called it,
+// on fruit.jpg and on large synthetic images of random lines. Both include the Canny edge detection.
+// Returns 1 if houghEngine misses more than 1% of the lines HoughLines() finds on any image
+// Run as ./hough_benchmark [image], fruit.jpg by default
+// Compile with: g++ -O3 hough_benchmark.cpp -o hough_benchmark `pkg-config --cflags --libs opencv`
+
+#include <opencv2/opencv.hpp>
+#include <iomanip>
+#include "../include/houghEngine.h"
+
+using namespace std;
+using namespace cv;
+
+// Image of random lines on a noisy background
+Mat synthetic(Size size, int lines, RNG &rng) {
+    Mat img(size, CV_8UC3);
+    rng.fill(img, RNG::UNIFORM, Scalar::all(0), Scalar::all(40));
+    for(int i = 0; i < lines; i++) {
+        Point p1(rng.uniform(0, size.width), rng.uniform(0, size.height)), p2(rng.uniform(0, size.width), rng.uniform(0, size.height));
+        line(img, p1, p2, Scalar::all(rng.uniform(128, 256)), rng.uniform(1, 4));
+    }
+    return img;
+}
+
+// Fraction of the lines of 'ref' also in 'lines'
+double found(const vector<Vec2f> &lines, const vector<Vec2f> &ref) {
+    if(ref.empty()) return 1;
+    int count = 0;
+    for(int i = 0; i < ref.size(); i++) {
+        for(int j = 0; j < lines.size(); j++) {
+            if(fabs(lines[j][0] - ref[i][0]) < 1e-3 && fabs(lines[j][1] - ref[i][1]) < 1e-5) {
+                count++;
+                break;
+            }
+        }
+    }
+    return double(count) / ref.size();
+}
+
+int main(int argc, char **argv) {
+    string filename = argc > 1 ? argv[1] : "fruit.jpg";
+    Mat photo = imread(filename);
+    if(photo.empty()) {
+        cout << "Could not read " << filename << endl;
+        return -1;
+    }
+
+    // change if you want
+    int runs = 5;
+    double min_found = 0.99; // fraction of the lines of HoughLines() that must be found
+    RNG rng(1);
+    vector<Mat> images;
+    vector<string> names;
+    vector<int> thresholds;
+    images.push_back(photo); names.push_back(filename); thresholds.push_back(100);
+    images.push_back(synthetic(Size(2000, 2000), 50, rng)); names.push_back("synthetic 4 MP"); thresholds.push_back(400);
+    images.push_back(synthetic(Size(5472, 3648), 100, rng)); names.push_back("synthetic 20 MP"); thresholds.push_back(800);
+
+    cout << getNumThreads() << " threads, " << runs << " runs each" << endl;
+    cout << setw(18) << "image" << setw(10) << "lines" << setw(16) << "HoughLines ms" << setw(16) << "houghEngine ms"
+         << setw(10) << "speedup" << setw(10) << "found %" << endl;
+
+    bool pass = true;
+    for(int k = 0; k < images.size(); k++) {
+        // HoughLines() as code6-3 called it
+        vector<Vec2f> ref;
+        double t0 = getTickCount();
+        for(int i = 0; i < runs; i++) {
+            Mat edges;
+            Canny(images[k], edges, 50, 100);
+            HoughLines(edges, ref, 1, CV_PI/180.f, thresholds[k]);
+        }
+        double ref_ms = 1000 * (getTickCount() - t0) / getTickFrequency() / runs;
+
+        // houghEngine, with a new image every run so that the edges and votes are recomputed
+        houghEngine hough;
+        vector<Vec2f> lines;
+        t0 = getTickCount();
+        for(int i = 0; i < runs; i++) {
+            hough.set_image(images[k]);
+            hough.lines(lines, thresholds[k], 1, CV_PI/180.f, 50, 100);
+        }
+        double ms = 1000 * (getTickCount() - t0) / getTickFrequency() / runs;
+
+        double f = found(lines, ref);
+        if(f < min_found) pass = false;
+        cout << setw(18) << names[k] << setw(10) << ref.size() << setw(16) << ref_ms << setw(16) << ms
+             << setw(10) << ref_ms / ms << setw(10) << 100 * f << (f < min_found ? "  FAIL" : "") << endl;
+    }
+
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,120 @@
+// Program to count the operator new calls and time taken by RANSAC hypotheses on the contours code6-4 finds in eye.jpg,
+// drawing samples by copying and shuffling each contour as code6-4 did before, and as indices into one buffer of all
+// contours as it does now. Allocations through operator new are counted, and Eigen is told to abort on any heap
+// allocation while samples are drawn as indices. Returns 1 if drawing samples as indices calls operator new
+// Run as ./sample_benchmark [image], eye.jpg by default
+// Compile with: g++ -O3 sample_benchmark.cpp -o sample_benchmark -I/usr/include/eigen3 `pkg-config --cflags --libs opencv`
+
+#define EIGEN_RUNTIME_NO_MALLOC
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include "../include/ellipseKernels.h"
+#include "../include/allocCounter.h"
+
+using namespace std;
+using namespace cv;
+
+// Contours of an image extracted like code6-4 does
+vector<vector<Point> > eye_contours(const Mat &img) {
+    Mat img_b, edges;
+    GaussianBlur(img, img_b, Size(7, 7), 0);
+    Canny(img_b, edges, 50, 150);
+    vector<vector<Point> > c, contours;
+    findContours(edges, c, CV_RETR_LIST, CV_CHAIN_APPROX_NONE);
+    keep_long_contours(c, contours);
+    return contours;
+}
+
+// Hypotheses on one contour with samples drawn as before: the contour is copied, shuffled and split into the sample
+// and the rest on every iteration
+int run_copying(const vector<Point> &contour, const float *x, const float *y, int iter, int N, float thresh, unsigned char *inlier) {
+    int best = 0;
+    for(int j = 0; j < iter; j++) {
+        vector<Point> c = contour;
+        random_shuffle(c.begin(), c.end());
+        vector<Point> cr0, cr1;
+        for(int i = 0; i < c.size(); i++) {
+            if(i < N) cr0.push_back(c[i]);
+            else cr1.push_back(c[i]);
+        }
+        float q[6];
+        if(!fit_conic(&cr0[0], cr0.size(), q)) continue;
+        best = max(best, count_inliers(q, x, y, contour.size(), thresh, inlier));
+    }
+    return best;
+}
+
+// Hypotheses on one contour with samples drawn as indices into the shared buffer
+int run_indexed(const float *x, const float *y, int n, int iter, int N, float thresh, RNG &rng, int *sample, unsigned char *inlier) {
+    int best = 0;
+    for(int j = 0; j < iter; j++) {
+        int n_sample = draw_sample(n, N, rng, sample);
+        float q[6];
+        if(!fit_conic_sample(x, y, sample, n_sample, q)) continue;
+        best = max(best, count_inliers(q, x, y, n, thresh, inlier));
+    }
+    return best;
+}
+
+int main(int argc, char **argv) {
+    string filename = argc > 1 ? argv[1] : "eye.jpg";
+    Mat img = imread(filename);
+    if(img.empty()) {
+        cout << "Could not read " << filename << endl;
+        return -1;
+    }
+
+    // RANSAC parameters of code6-4, change if you want
+    int iter = 400, min_inliers = 100, N = 5;
+    float dist_thresh = 1;
+
+    vector<vector<Point> > contours = eye_contours(img);
+    contoursSoA points;
+    points.assign(contours);
+    vector<unsigned char> inlier(points.x.size());
+    vector<int> sample(N);
+    int hypotheses = 0;
+    for(int i = 0; i < contours.size(); i++)
+        if(contours[i].size() >= min_inliers) hypotheses += iter;
+    if(hypotheses == 0) {
+        cout << "No contour has " << min_inliers << " points" << endl;
+        return -1;
+    }
+
+    // copying samples
+    unsigned long a0 = allocations;
+    double t0 = getTickCount();
+    int score_copying = 0;
+    for(int i = 0; i < contours.size(); i++) {
+        if(contours[i].size() < min_inliers) continue;
+        score_copying = max(score_copying, run_copying(contours[i], points.xs(i), points.ys(i), iter, N, dist_thresh, &inlier[0]));
+    }
+    double t_copying = (getTickCount() - t0) / getTickFrequency();
+    unsigned long allocs_copying = allocations - a0;
+
+    // index samples, with Eigen heap allocations turned into an assertion
+    RNG rng(12345);
+    a0 = allocations;
+    Eigen::internal::set_is_malloc_allowed(false);
+    t0 = getTickCount();
+    int score_indexed = 0;
+    for(int i = 0; i < contours.size(); i++) {
+        if(points.size(i) < min_inliers) continue;
+        score_indexed = max(score_indexed, run_indexed(points.xs(i), points.ys(i), points.size(i), iter, N, dist_thresh, rng, &sample[0], &inlier[0]));
+    }
+    double t_indexed = (getTickCount() - t0) / getTickFrequency();
+    Eigen::internal::set_is_malloc_allowed(true);
+    unsigned long allocs_indexed = allocations - a0;
+
+    cout << contours.size() << " contours, " << points.x.size() << " points, " << hypotheses << " hypotheses" << endl;
+    cout << "  copying samples: " << 1e6 * t_copying / hypotheses << " us/hypothesis, " << double(allocs_copying) / hypotheses
+         << " operator new calls/hypothesis, best " << score_copying << " inliers" << endl;
+    cout << "  index samples:   " << 1e6 * t_indexed / hypotheses << " us/hypothesis, " << double(allocs_indexed) / hypotheses
+         << " operator new calls/hypothesis, best " << score_indexed << " inliers" << endl;
+    if(allocs_indexed != 0) {
+        cout << "Index samples called operator new" << endl;
+        return 1;
+    }
+
+    return 0;
+}
@@ -1,10 +1,13 @@
 // Program to display a video from attached default camera device and detect colored blobs using H and S thresholding
 // Remove noise using opening and closing morphological operations
 // Author: Samarth Manoj Brahmbhatt, University of Pennsylvania
+// Compile with: g++ -O3 -msse2 code7-1.cpp -o code7-1 `pkg-config --cflags --libs opencv` -lboost_thread -lboost_system
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/headless.h"
+#include "../include/blobSegmenter.h"
 
 using namespace cv;
 using namespace std;
@@ -52,11 +55,15 @@ void on_high_thresh_trackbar(int, void *) {
     }
 }
 
-int main()
+int main(int argc, char **argv)
 {
+    // Run with --headless <file> to benchmark without a display
+    headlessRunner hr(argc, argv);
+
     // Create a VideoCapture object to read from video file
     // 0 is the ID of the built-in laptop camera, change if you want to use other camera
-    VideoCapture cap(0);
+    VideoCapture cap;
+    hr.open(cap, 0);
     
     //check if the file was opened properly
     if(!cap.isOpened())
@@ -65,44 +72,54 @@ int main()
             return -1;
     }
 
-    namedWindow("Video");
-    namedWindow("Segmentation");
+    if(!hr.is_headless()) {
+        namedWindow("Video");
+        namedWindow("Segmentation");
+
+        createTrackbar("0. H\n1. S", "Segmentation", &hs_slider, 1, on_hs_trackbar);
+        createTrackbar("Low threshold", "Segmentation", &low_slider, 255, on_low_thresh_trackbar);
+        createTrackbar("High threshold", "Segmentation", &high_slider, 255, on_high_thresh_trackbar);
+    }
 
-    createTrackbar("0. H\n1. S", "Segmentation", &hs_slider, 1, on_hs_trackbar);
-    createTrackbar("Low threshold", "Segmentation", &low_slider, 255, on_low_thresh_trackbar);
-    createTrackbar("High threshold", "Segmentation", &high_slider, 255, on_high_thresh_trackbar);
+    // thresholds, opens and closes in one pass, with the structuring element decomposed once
+    blobSegmenter segmenter(getStructuringElement(MORPH_ELLIPSE, Size(7, 7)));
     
-    while(char(waitKey(1)) != 'q' && cap.isOpened())
+    // profiler ids of the stages, looked up once outside of the frame loop
+    const int capture_id = hr.stage_id("capture"), convert_id = hr.stage_id("convert"),
+              segmentation_id = hr.stage_id("segmentation"), display_id = hr.stage_id("display");
+
+    while(hr.next() && cap.isOpened())
     {
         Mat frame, frame_thresholded, frame_hsv;
                     
+        hr.stage(capture_id);
         cap >> frame;
 
-        cvtColor(frame, frame_hsv, CV_BGR2HSV);
-
         // Check if the video is over
         if(frame.empty())
         {
                 cout << "Video over" << endl;
                 break;
         }
+
+        hr.stage(convert_id);
+        cvtColor(frame, frame_hsv, CV_BGR2HSV);
         
         // extract the Hue and Saturation channels
         int from_to[] = {0,0, 1,1};
         Mat hs(frame.size(), CV_8UC2);
         mixChannels(&frame_hsv, 1, &hs, 1, from_to, 2);
 
-        // check the image for a specific range of H and S
-        inRange(hs, Scalar(low_h, low_s), Scalar(high_h, high_s), frame_thresholded);
-
-        // open and close to remove noise
-        Mat str_el = getStructuringElement(MORPH_ELLIPSE, Size(7, 7));
-        morphologyEx(frame_thresholded, frame_thresholded, MORPH_OPEN, str_el);
-        morphologyEx(frame_thresholded, frame_thresholded, MORPH_CLOSE, str_el);
+        // check the image for a specific range of H and S, then open and close to remove noise
+        hr.stage(segmentation_id);
+        segmenter.segment(hs, Scalar(low_h, low_s), Scalar(high_h, high_s), frame_thresholded);
         
-        imshow("Video", frame);
-        imshow("Segmentation", frame_thresholded);
+        hr.stage(display_id);
+        hr.show("Video", frame);
+        hr.show("Segmentation", frame_thresholded);
     }
 
+    hr.report();
+
     return 0;
 }
@@ -4,6 +4,7 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/morphologyEngine.h"
 
 using namespace cv;
 using namespace std;
@@ -78,8 +79,8 @@ int main() {
 
         // open and close to remove noise
         Mat str_el = getStructuringElement(MORPH_RECT, Size(5, 5));
-        morphologyEx(frame_thresholded, frame_thresholded, MORPH_OPEN, str_el);
-        morphologyEx(frame_thresholded, frame_thresholded, MORPH_CLOSE, str_el);
+        fast_morphologyEx(frame_thresholded, frame_thresholded, MORPH_OPEN, str_el);
+        fast_morphologyEx(frame_thresholded, frame_thresholded, MORPH_CLOSE, str_el);
         
         imshow("Video", frame);
         imshow("Segmentation", frame_thresholded);
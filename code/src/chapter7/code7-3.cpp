@@ -4,6 +4,7 @@
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
+#include "../include/morphologyEngine.h"
 
 using namespace cv;
 using namespace std;
@@ -31,13 +32,13 @@ void objectCounter::get_markers() {
 
     // dilate to remove small black spots
     Mat strel = getStructuringElement(MORPH_ELLIPSE, Size(9, 9));
-    Mat im_d; dilate(im_e, im_d, strel);
+    Mat im_d; fast_dilate(im_e, im_d, strel);
     //imshow("im_d", im_d);
 
     // open and close to highlight objects
     strel = getStructuringElement(MORPH_ELLIPSE, Size(19, 19));
-    Mat im_oc; morphologyEx(im_d, im_oc, MORPH_OPEN, strel);
-    morphologyEx(im_oc, im_oc, MORPH_CLOSE, strel);
+    Mat im_oc; fast_morphologyEx(im_d, im_oc, MORPH_OPEN, strel);
+    fast_morphologyEx(im_oc, im_oc, MORPH_CLOSE, strel);
     //imshow("im_oc", im_oc);
 
     // adaptive threshold to create binary image
@@ -45,7 +46,7 @@ void objectCounter::get_markers() {
     //imshow("th_a", th_a);
 
     // erode binary image twice to separate regions
-    Mat th_e; erode(th_a, th_e, strel, Point(-1, -1), 2);
+    Mat th_e; fast_erode(th_a, th_e, strel, Point(-1, -1), 2);
     //imshow("th_e", th_e);
 
     vector<vector<Point> > c, contours;
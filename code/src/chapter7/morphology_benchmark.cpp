@@ -0,0 +1,67 @@
+// Program to benchmark the van Herk/Gil-Werman morphology engine of morphologyEngine.h against erode() and dilate()
+// for rectangular and elliptical structuring elements from 3x3 to 41x41.
+// Returns 1 if the engine result differs from that of OpenCV anywhere
+// Run as ./morphology_benchmark [image], fruit.jpg by default
+// Compile with: g++ -O3 -msse2 morphology_benchmark.cpp -o morphology_benchmark `pkg-config --cflags --libs opencv`
+
+#include <opencv2/opencv.hpp>
+#include <iomanip>
+#include "../include/morphologyEngine.h"
+
+using namespace std;
+using namespace cv;
+
+int main(int argc, char **argv) {
+    string filename = argc > 1 ? argv[1] : "fruit.jpg";
+    Mat image = imread(filename, CV_LOAD_IMAGE_GRAYSCALE);
+    if(image.empty()) {
+        cout << "Could not read " << filename << endl;
+        return -1;
+    }
+
+    // change if you want
+    int runs = 5;
+    Size size(1920, 1080);
+    int min_size = 3, max_size = 41;
+
+    Mat img;
+    resize(image, img, size);
+    const char *shape_names[] = {"rect", "ellipse"};
+    int shapes[] = {MORPH_RECT, MORPH_ELLIPSE};
+
+    cout << size.width << "x" << size.height << " gray, " << getNumThreads() << " threads, " << runs << " runs each" << endl;
+    cout << setw(9) << "element" << setw(6) << "size" << setw(12) << "erode ms" << setw(12) << "engine ms" << setw(10) << "speedup"
+         << setw(12) << "dilate ms" << setw(12) << "engine ms" << setw(10) << "speedup" << endl;
+
+    bool pass = true;
+    for(int shape = 0; shape < 2; shape++) {
+        for(int s = min_size; s <= max_size; s += 2) {
+            Mat strel = getStructuringElement(shapes[shape], Size(s, s));
+            cout << setw(9) << shape_names[shape] << setw(6) << s;
+            bool same = true;
+            for(int op = 0; op < 2; op++) {
+                Mat ref, out;
+                double t0 = getTickCount();
+                for(int i = 0; i < runs; i++) {
+                    if(op == 0) erode(img, ref, strel);
+                    else dilate(img, ref, strel);
+                }
+                double ref_ms = 1000 * (getTickCount() - t0) / getTickFrequency() / runs;
+
+                t0 = getTickCount();
+                for(int i = 0; i < runs; i++) {
+                    if(op == 0) morph_engine<morphMin>(img, out, strel);
+                    else morph_engine<morphMax>(img, out, strel);
+                }
+                double ms = 1000 * (getTickCount() - t0) / getTickFrequency() / runs;
+
+                if(countNonZero(ref != out) > 0) same = false;
+                cout << setw(12) << ref_ms << setw(12) << ms << setw(10) << ref_ms / ms;
+            }
+            if(!same) pass = false;
+            cout << (same ? "" : "  FAIL") << endl;
+        }
+    }
+
+    return pass ? 0 : 1;
+}
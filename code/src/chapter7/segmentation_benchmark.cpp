@@ -0,0 +1,87 @@
+// Program to benchmark blobSegmenter against the inRange() and morphologyEx() chain of the colour blob detectors
+// on 640x480 frames, with the thresholds and structuring elements of code5-8 (B, G, R and a 3x3 rectangle) and
+// code7-1 (H, S and a 7x7 ellipse).
+// Returns 1 if the masks differ anywhere
+// Run as ./segmentation_benchmark [image], fruit.jpg by default
+// Compile with: g++ -O3 -msse2 segmentation_benchmark.cpp -o segmentation_benchmark `pkg-config --cflags --libs opencv`
+
+#include <opencv2/opencv.hpp>
+#include <iomanip>
+#include "../include/blobSegmenter.h"
+
+using namespace std;
+using namespace cv;
+
+int main(int argc, char **argv) {
+    string filename = argc > 1 ? argv[1] : "fruit.jpg";
+    Mat image = imread(filename);
+    if(image.empty()) {
+        cout << "Could not read " << filename << endl;
+        return -1;
+    }
+
+    // change if you want
+    int frames = 200;
+    Size size(640, 480);
+    double target = 3; // speedup aimed at
+
+    // frames are the image with fresh noise, so that masks change like they do on camera input
+    Mat img;
+    resize(image, img, size);
+    RNG rng(1);
+    vector<Mat> bgr(8), hs(8);
+    for(int i = 0; i < bgr.size(); i++) {
+        Mat noise(size, CV_8UC3), hsv;
+        rng.fill(noise, RNG::UNIFORM, Scalar::all(0), Scalar::all(20));
+        bgr[i] = img + noise;
+        cvtColor(bgr[i], hsv, CV_BGR2HSV);
+        int from_to[] = {0,0, 1,1};
+        hs[i].create(size, CV_8UC2);
+        mixChannels(&hsv, 1, &hs[i], 1, from_to, 2);
+    }
+
+    const char *names[] = {"code5-8 BGR, 3x3 rect", "code7-1 HS, 7x7 ellipse"};
+    int shapes[] = {MORPH_RECT, MORPH_ELLIPSE}, sizes[] = {3, 7};
+    Scalar lows[] = {Scalar(30, 30, 30), Scalar(30, 30)}, highs[] = {Scalar(100, 100, 100), Scalar(100, 100)};
+
+    cout << size.width << "x" << size.height << ", " << frames << " frames" << endl;
+    cout << setw(26) << "program" << setw(12) << "chain ms" << setw(12) << "fused ms" << setw(10) << "speedup" << endl;
+
+    bool pass = true;
+    for(int p = 0; p < 2; p++) {
+        vector<Mat> &input = p == 0 ? bgr : hs;
+        Mat ref, mask;
+
+        // the chain as the programs ran it, building the element every frame
+        double t0 = getTickCount();
+        for(int i = 0; i < frames; i++) {
+            inRange(input[i % input.size()], lows[p], highs[p], ref);
+            Mat str_el = getStructuringElement(shapes[p], Size(sizes[p], sizes[p]));
+            morphologyEx(ref, ref, MORPH_OPEN, str_el);
+            morphologyEx(ref, ref, MORPH_CLOSE, str_el);
+        }
+        double ref_ms = 1000 * (getTickCount() - t0) / getTickFrequency() / frames;
+
+        blobSegmenter segmenter(getStructuringElement(shapes[p], Size(sizes[p], sizes[p])));
+        t0 = getTickCount();
+        for(int i = 0; i < frames; i++) segmenter.segment(input[i % input.size()], lows[p], highs[p], mask);
+        double ms = 1000 * (getTickCount() - t0) / getTickFrequency() / frames;
+
+        // masks of every frame must be the same
+        bool same = true;
+        for(int i = 0; i < input.size(); i++) {
+            inRange(input[i], lows[p], highs[p], ref);
+            Mat str_el = getStructuringElement(shapes[p], Size(sizes[p], sizes[p]));
+            morphologyEx(ref, ref, MORPH_OPEN, str_el);
+            morphologyEx(ref, ref, MORPH_CLOSE, str_el);
+            segmenter.segment(input[i], lows[p], highs[p], mask);
+            if(countNonZero(ref != mask) > 0) same = false;
+        }
+        if(!same) pass = false;
+
+        cout << setw(26) << names[p] << setw(12) << ref_ms << setw(12) << ms << setw(10) << ref_ms / ms
+             << (ref_ms / ms < target ? "  below target" : "") << (same ? "" : "  FAIL") << endl;
+    }
+
+    return pass ? 0 : 1;
+}
@@ -1,15 +1,20 @@
 // Program to illustrate SIFT keypoint and descriptor extraction, and matching using brute force
 // Author: Samarth Manoj Brahmbhatt, University of Pennsylvania
+// Compile with: g++ code8-1.cpp -o code8-1 `pkg-config --cflags --libs opencv` -lboost_thread -lboost_system
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/nonfree/features2d.hpp>
 #include <opencv2/features2d/features2d.hpp>
+#include "../include/headless.h"
 
 using namespace cv;
 using namespace std;
 
-int main() {
+int main(int argc, char **argv) {
+    // Run with --headless <file> to benchmark without a display
+    headlessRunner hr(argc, argv);
+
     Mat train = imread("template.jpg"), train_g;
     cvtColor(train, train_g, CV_BGR2GRAY);
 
@@ -29,26 +34,39 @@ int main() {
     matcher.train();
 
     // VideoCapture object
-    VideoCapture cap(0);
+    VideoCapture cap;
+    hr.open(cap, 0);
+
+    // Per-stage timings and the frame rate are written to profile.csv every second
+    stageProfiler::instance().start_dump("profile.csv", 1);
 
-    unsigned int frame_count = 0;
+    // profiler ids of the stages, looked up once outside of the frame loop
+    const int capture_id = hr.stage_id("capture"), convert_id = hr.stage_id("convert"), detect_id = hr.stage_id("detect"),
+              describe_id = hr.stage_id("describe"), match_id = hr.stage_id("match"), draw_id = hr.stage_id("draw");
 
-    while(char(waitKey(1)) != 'q') {
-        double t0 = getTickCount();
+    while(hr.next()) {
         Mat test, test_g;
+        hr.stage(capture_id);
         cap >> test;
-        if(test.empty())
+        if(test.empty()) {
+            // a camera can return an empty frame now and then, a file is over
+            if(hr.is_headless()) break;
             continue;
+        }
 
+        hr.stage(convert_id);
         cvtColor(test, test_g, CV_BGR2GRAY);
 
         //detect SIFT keypoints and extract descriptors in the test image
         vector<KeyPoint> test_kp;
         Mat test_desc;
+        hr.stage(detect_id);
         featureDetector.detect(test_g, test_kp);
+        hr.stage(describe_id);
         featureExtractor.compute(test_g, test_kp, test_desc);
 
         // match train and test descriptors, getting 2 nearest neighbors for all test descriptors
+        hr.stage(match_id);
         vector<vector<DMatch> > matches;
         matcher.knnMatch(test_desc, matches, 2);
 
@@ -59,12 +77,14 @@ int main() {
                 good_matches.push_back(matches[i][0]);
         }
 
+        hr.stage(draw_id);
         Mat img_show;
         drawMatches(test, test_kp, train, train_kp, good_matches, img_show);
-        imshow("Matches", img_show);
-
-        cout << "Frame rate = " << getTickFrequency() / (getTickCount() - t0) << endl;
+        hr.show("Matches", img_show);
     }
 
+    stageProfiler::instance().stop_dump();
+    hr.report();
+
     return 0;
 }
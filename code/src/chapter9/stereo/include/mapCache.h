@@ -0,0 +1,53 @@
+// Binary cache of the stereo rectification maps
+// The pixel maps and rectification transforms are computed from the calibration parameters in stereo_calib.xml
+// once and stored in a raw binary file next to it, keyed by a hash of the calibration parameters and image size.
+// Later runs mmap the file and wrap the matrices in Mat headers without copying or parsing anything. The cache is
+// regenerated when the calibration or the image size changes
+
+#ifndef MAP_CACHE_H
+#define MAP_CACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <string>
+#include <vector>
+
+class mapCache {
+    private:
+        void *mapping; // mmapped cache file
+        size_t length;
+        bool regenerated; // maps were computed by the last call to open()
+
+        void unmap();
+        bool load(const std::string &path, unsigned long long key, cv::Size image_size); // mmap and validate the cache file
+        static void compute(const std::vector<cv::Mat> &params, cv::Size image_size, std::vector<cv::Mat> &mats); // rectify from calibration
+        void assign(const std::vector<cv::Mat> &mats); // point the public matrices at 'mats'
+        bool save(const std::string &path, unsigned long long key, cv::Size image_size, const std::vector<cv::Mat> &mats);
+
+        // owns a mapping, so no copies
+        mapCache(const mapCache &);
+        mapCache &operator=(const mapCache &);
+    public:
+        // Rectification maps (CV_16SC2 and CV_16UC1 as made by initUndistortRectifyMap), rectification transforms and Q
+        // After open() they point into the read-only mapped file and stay valid until the mapCache is destroyed
+        cv::Mat map_l1, map_l2, map_r1, map_r2;
+        cv::Mat Rl, Rr, Pl, Pr, Q;
+
+        mapCache();
+        ~mapCache();
+
+        // Load the maps for 'image_size' from the cache belonging to 'calib_filename' (stereo_calib.xml),
+        // computing and saving them first if the cache is missing or was made from other parameters
+        bool open(const std::string &calib_filename, cv::Size image_size);
+        bool was_regenerated() const { return regenerated; }
+
+        // Rectify a stereo pair into the left and right halves of 'combo', which is (re)allocated only when the frame
+        // size or type changes. Both images are remapped at once, split into row bands run by parallel_for_
+        void rectify(const cv::Mat &left, const cv::Mat &right, cv::Mat &combo) const;
+
+        // Cache file used for a calibration file: stereo_calib.xml -> stereo_calib.maps
+        static std::string cache_filename(const std::string &calib_filename);
+        // 64 bit FNV-1a hash of the type, size and contents of the matrices and the image size
+        static unsigned long long hash(const std::vector<cv::Mat> &params, cv::Size image_size);
+};
+
+#endif
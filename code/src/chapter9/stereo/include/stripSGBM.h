@@ -0,0 +1,31 @@
+// Strip-parallel semi-global block matching
+// The rectified pair is split into horizontal strips that are matched concurrently by parallel_for_. Every strip
+// is matched together with 'overlap()' rows of context above and below it, so that the SAD window and most of the
+// smoothing along vertical and diagonal paths see the same pixels as in a full frame match, and only the strip's
+// own rows are copied into the output
+
+#ifndef STRIP_SGBM_H
+#define STRIP_SGBM_H
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <vector>
+
+// Used exactly like StereoSGBM: set the public parameters, then call it on a rectified pair
+class stripSGBM : public cv::StereoSGBM {
+    private:
+        int strips; // number of strips, 0 for one per OpenCV thread
+        int smoothing_rows; // context rows added for the path smoothing on top of the SAD window radius
+        std::vector<cv::StereoSGBM> matchers; // one per strip, they keep their buffers between frames
+    public:
+        stripSGBM(int _strips = 0, int _smoothing_rows = 16);
+
+        void set_strips(int _strips) { strips = _strips; }
+        int get_strips(int rows) const; // strips actually used for images with 'rows' rows
+        int overlap() const; // context rows on each side of a strip
+
+        // Disparity of the rectified pair, CV_16S scaled by 16 like StereoSGBM
+        virtual void operator()(cv::InputArray left, cv::InputArray right, cv::OutputArray disp);
+};
+
+#endif
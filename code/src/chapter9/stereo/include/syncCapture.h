@@ -0,0 +1,60 @@
+// Synchronized capture from N cameras (or videos standing in for them)
+// Every stream is read on its own thread and each frame is timestamped as soon as it is grabbed. read() hands out
+// bundles with one frame per stream, choosing frames whose timestamps are closest to each other and at most
+// 'tolerance' ms apart, and discards frames that cannot be paired
+
+#ifndef SYNC_CAPTURE_H
+#define SYNC_CAPTURE_H
+
+#include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+#include <deque>
+#include <string>
+#include <vector>
+
+class syncCapture {
+    private:
+        struct stream {
+            cv::VideoCapture cap;
+            bool is_file;
+            double period, offset; // pacing period of a file source (0 for as fast as possible) and timestamp offset, in ms
+            std::deque<std::pair<double, cv::Mat> > q; // timestamped frames waiting to be paired
+            bool finished; // camera failed or file is over
+            // statistics
+            unsigned long captured, overflow_drops, unmatched_drops;
+        };
+
+        std::vector<stream *> streams;
+        boost::thread_group threads;
+        boost::mutex mtx;
+        boost::condition_variable new_frame, space;
+        double tolerance; // maximum timestamp difference of frames in a bundle in ms
+        int queue_size; // frames kept per stream
+        bool running;
+
+        // statistics
+        unsigned long bundles;
+        double skew_sum, skew_max;
+
+        void run(stream *); // function run by the thread of each stream
+        static double now(); // clock used for camera timestamps, in ms
+    public:
+        syncCapture(double _tolerance, int _queue_size = 4); // constructor
+        ~syncCapture();
+
+        // Add a camera, returns the index of its frames in the bundles
+        int add_camera(int id, cv::Size size);
+        // Add a video file or image sequence standing in for a camera
+        // fps = 0: read as fast as possible, frames are timestamped with their position in the file and never dropped
+        // fps > 0: play back in real time like a camera, frames are timestamped with the clock
+        // offset_ms is added to the timestamps to simulate skew between cameras
+        int add_file(const std::string &filename, double fps = 0, double offset_ms = 0);
+
+        void start(); // start the capture threads
+        void stop(); // stop the capture threads
+        // Wait for the next synchronized bundle, false when a stream has ended
+        bool read(std::vector<cv::Mat> &frames, std::vector<double> *timestamps = NULL);
+        void print_stats();
+};
+
+#endif
@@ -0,0 +1,41 @@
+// Incremental disparity for a fixed stereo rig
+// Most of the scene seen by a fixed rig is static, so consecutive left frames are compared tile by tile and
+// disparity is recomputed only for the tiles that changed, plus a margin, reusing the previous disparity elsewhere.
+// The whole frame is recomputed periodically and whenever the matcher parameters change, so that slow drift and
+// errors around the recomputed regions do not accumulate
+
+#ifndef TEMPORAL_DISPARITY_H
+#define TEMPORAL_DISPARITY_H
+
+#include <opencv2/opencv.hpp>
+#include <vector>
+#include "stripSGBM.h"
+
+class temporalDisparity {
+    private:
+        stripSGBM *stereo; // matcher used for full frames and changed regions
+        int tile; // side of the tiles compared between frames, in pixels
+        double threshold; // mean absolute gray level difference above which a tile has changed
+        int margin; // pixels recomputed around changed tiles
+        int refresh; // recompute the full frame every 'refresh' frames
+        cv::Mat prev_gray, cache; // previous left frame and disparity
+        int cached_min_disp, cached_num_disp; // parameters the cache was computed with
+
+        // statistics
+        unsigned long frames, full_frames;
+        double fraction, fraction_sum; // fraction of the frame area recomputed
+
+        void full(const cv::Mat &left, const cv::Mat &right);
+        void update(const cv::Mat &left, const cv::Mat &right, cv::Rect region); // recompute one region of the cache
+    public:
+        temporalDisparity(stripSGBM *_stereo, int _tile = 32, double _threshold = 6, int _margin = 16, int _refresh = 30);
+
+        // Disparity of the rectified pair like StereoSGBM, recomputing only what changed since the last call
+        void operator()(const cv::Mat &left, const cv::Mat &right, cv::Mat &disp);
+
+        double last_fraction() const { return fraction; } // area recomputed for the last frame, 0 to 1
+        double mean_fraction() const { return frames ? fraction_sum / frames : 0; }
+        void print_stats();
+};
+
+#endif
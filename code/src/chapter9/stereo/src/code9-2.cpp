@@ -3,36 +3,32 @@
 
 #include <opencv2/opencv.hpp>
 #include <opencv2/highgui/highgui.hpp>
+#include "syncCapture.h"
 
 using namespace cv;
 using namespace std;
 
 int main() {
-    VideoCapture capr(1), capl(2);
-    //reduce frame size
-    capl.set(CV_CAP_PROP_FRAME_HEIGHT, 240);
-    capl.set(CV_CAP_PROP_FRAME_WIDTH, 320);
-    capr.set(CV_CAP_PROP_FRAME_HEIGHT, 240);
-    capr.set(CV_CAP_PROP_FRAME_WIDTH, 320);
+    // Capture both cameras on their own threads at reduced frame size and pair frames
+    // grabbed at most 15 ms apart (half the frame period of a 30 fps camera), change if you want
+    syncCapture cap(15);
+    cap.add_camera(2, Size(320, 240)); // left
+    cap.add_camera(1, Size(320, 240)); // right
+    cap.start();
+    vector<Mat> frames;
 
     namedWindow("Left");
     namedWindow("Right");
 
     while(char(waitKey(1)) != 'q') {
-        //grab raw frames first
-        capl.grab();
-        capr.grab();
-        //decode later so the grabbed frames are less apart in time
-        Mat framel, framer;
-        capl.retrieve(framel);
-        capr.retrieve(framer);
-
-        if(framel.empty() || framer.empty()) break;
+        //wait for the next pair of frames grabbed close together in time
+        if(!cap.read(frames)) break;
+        Mat framel = frames[0], framer = frames[1];
 
         imshow("Left", framel);
         imshow("Right", framer);
     }
-    capl.release();
-    capr.release();
+    cap.stop();
+    cap.print_stats();
     return 0;
 }
@@ -6,6 +6,8 @@
 #include <opencv2/calib3d/calib3d.hpp>
 #include <boost/filesystem.hpp>
 #include "Config.h"
+#include "syncCapture.h"
+#include "mapCache.h"
 
 using namespace cv;
 using namespace std;
@@ -33,7 +35,7 @@ class calibrator {
 
 class rectifier {
     private:
-        Mat map_l1, map_l2, map_r1, map_r2; //pixel maps for rectification
+        mapCache maps; //pixel maps for rectification
         string path;
     public:
         rectifier(string, Size); //constructor
@@ -147,70 +149,34 @@ Size calibrator::get_image_size() {
 }
 
 rectifier::rectifier(string filename, Size image_size) {
-    // Read individal camera calibration information from saved XML file
-    Mat l_cameraMatrix, l_distCoeffs, r_cameraMatrix, r_distCoeffs, R, T;
-    FileStorage fs(filename, FileStorage::READ);
-    fs["l_cameraMatrix"] >> l_cameraMatrix;
-    fs["l_distCoeffs"] >> l_distCoeffs;
-    fs["r_cameraMatrix"] >> r_cameraMatrix;
-    fs["r_distCoeffs"] >> r_distCoeffs;
-    fs["R"] >> R;
-    fs["T"] >> T;
-    fs.release();
-
-    if(l_cameraMatrix.empty() || r_cameraMatrix.empty() || l_distCoeffs.empty() || r_distCoeffs.empty() || R.empty() || T.empty())
+    // Compute the rectification transforms and pixel maps from the calibration in the XML file, or map them
+    // from the binary cache next to it if they were already computed for this calibration and image size
+    if(!maps.open(filename, image_size))
         cout << "Rectifier: Loading of files not successful" << endl;
-
-    // Calculate transforms for rectifying images
-    Mat Rl, Rr, Pl, Pr, Q;
-    stereoRectify(l_cameraMatrix, l_distCoeffs, r_cameraMatrix, r_distCoeffs, image_size, R, T, Rl, Rr, Pl, Pr, Q);
-
-    // Calculate pixel maps for efficient rectification of images via lookup tables
-    initUndistortRectifyMap(l_cameraMatrix, l_distCoeffs, Rl, Pl, image_size, CV_16SC2, map_l1, map_l2);
-    initUndistortRectifyMap(r_cameraMatrix, r_distCoeffs, Rr, Pr, image_size, CV_16SC2, map_r1, map_r2);
-
-    fs.open(filename, FileStorage::APPEND);
-    fs << "Rl" << Rl;
-    fs << "Rr" << Rr;
-    fs << "Pl" << Pl;
-    fs << "Pr" << Pr;
-    fs << "Q" << Q;
-    fs << "map_l1" << map_l1;
-    fs << "map_l2" << map_l2;
-    fs << "map_r1" << map_r1;
-    fs << "map_r2" << map_r2;
-    fs.release();
+    else if(maps.was_regenerated())
+        cout << "Rectification maps computed for the current calibration, cached in " << mapCache::cache_filename(filename) << endl;
 }
 
 void rectifier::show_rectified(Size image_size) {
-    VideoCapture capr(1), capl(2);
-    //reduce frame size
-    capl.set(CV_CAP_PROP_FRAME_HEIGHT, image_size.height);
-    capl.set(CV_CAP_PROP_FRAME_WIDTH, image_size.width);
-    capr.set(CV_CAP_PROP_FRAME_HEIGHT, image_size.height);
-    capr.set(CV_CAP_PROP_FRAME_WIDTH, image_size.width);
+    // Capture both cameras on their own threads and pair frames grabbed at most 15 ms apart
+    syncCapture cap(15);
+    cap.add_camera(2, image_size); // left
+    cap.add_camera(1, image_size); // right
+    cap.start();
+    vector<Mat> frames;
 
     destroyAllWindows();
     namedWindow("Combo");
+    Mat combo; // allocated by the first frame and reused
     while(char(waitKey(1)) != 'q') {
-        //grab raw frames first
-        capl.grab();
-        capr.grab();
-        //decode later so the grabbed frames are less apart in time
-        Mat framel, framel_rect, framer, framer_rect;
-        capl.retrieve(framel);
-        capr.retrieve(framer);
-
-        if(framel.empty() || framer.empty()) break;
-
-        // Remap images by pixel maps to rectify
-        remap(framel, framel_rect, map_l1, map_l2, INTER_LINEAR);
-        remap(framer, framer_rect, map_r1, map_r2, INTER_LINEAR);
+        //wait for the next pair of frames grabbed close together in time
+        if(!cap.read(frames)) break;
+        Mat framel, framer;
+        framel = frames[0];
+        framer = frames[1];
 
-        // Make a larger image containing the left and right rectified images side-by-side
-        Mat combo(image_size.height, 2 * image_size.width, CV_8UC3);
-        framel_rect.copyTo(combo(Range::all(), Range(0, image_size.width)));
-        framer_rect.copyTo(combo(Range::all(), Range(image_size.width, 2*image_size.width)));
+        // Remap images by pixel maps to rectify, straight into a larger image holding them side-by-side
+        maps.rectify(framel, framer, combo);
 
         // Draw horizontal red lines in the combo image to make comparison easier
         for(int y = 0; y < combo.rows; y += 20)
@@ -218,8 +184,8 @@ void rectifier::show_rectified(Size image_size) {
 
         imshow("Combo", combo);
     }
-    capl.release();
-    capr.release();
+    cap.stop();
+    cap.print_stats();
 }
 
 int main() {
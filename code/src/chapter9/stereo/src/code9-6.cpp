@@ -5,20 +5,27 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include "Config.h"
+#include "headless.h"
+#include "syncCapture.h"
+#include "mapCache.h"
+#include "stripSGBM.h"
+#include "temporalDisparity.h"
 
 using namespace cv;
 using namespace std;
 
 class disparity {
     private:
-        Mat map_l1, map_l2, map_r1, map_r2; // rectification pixel maps
-        StereoSGBM stereo; // stereo matching object for disparity computation
+        mapCache maps; // rectification pixel maps
+        stripSGBM stereo; // stereo matching object for disparity computation, matches strips in parallel
+        temporalDisparity temporal; // recomputes disparity only where the scene changed
+        bool incremental; // use 'temporal' instead of matching every frame in full
         int min_disp, num_disp; // parameters of StereoSGBM
     public:
-        disparity(string, Size); //constructor
+        disparity(string, Size, bool); //constructor
         void set_minDisp(int minDisp) { stereo.minDisparity = minDisp; }
         void set_numDisp(int numDisp) { stereo.numberOfDisparities = numDisp; }
-        void show_disparity(Size); // show live disparity by processing stereo camera feed
+        void show_disparity(Size, headlessRunner &); // show live disparity by processing stereo camera feed
 };
 
 // Callback functions for minDisparity and numberOfDisparities trackbars
@@ -34,15 +41,11 @@ void on_numDisp(int num_disp, void * _disp_obj) {
     disp_obj -> set_numDisp(num_disp);
 }
 
-disparity::disparity(string filename, Size image_size) {
-    // Read pixel maps from XML file
-    FileStorage fs(filename, FileStorage::READ);
-    fs["map_l1"] >> map_l1;
-    fs["map_l2"] >> map_l2;
-    fs["map_r1"] >> map_r1;
-    fs["map_r2"] >> map_r2;
+disparity::disparity(string filename, Size image_size, bool _incremental) : temporal(&stereo) {
+    incremental = _incremental;
 
-    if(map_l1.empty() || map_l2.empty() || map_r1.empty() || map_r2.empty())
+    // Map pixel maps from the binary cache, computing them from the calibration in the XML file if needed
+    if(!maps.open(filename, image_size))
         cout << "WARNING: Loading of mapping matrices not successful" << endl;
 
     // Set SGBM parameters (from OpenCV stereo_match.cpp demo)
@@ -57,57 +60,90 @@ disparity::disparity(string filename, Size image_size) {
     stereo.fullDP = true;
 }
 
-void disparity::show_disparity(Size image_size) {
-    VideoCapture capr(1), capl(2);
-    //reduce frame size
-    capl.set(CV_CAP_PROP_FRAME_HEIGHT, image_size.height);
-    capl.set(CV_CAP_PROP_FRAME_WIDTH, image_size.width);
-    capr.set(CV_CAP_PROP_FRAME_HEIGHT, image_size.height);
-    capr.set(CV_CAP_PROP_FRAME_WIDTH, image_size.width);
+void disparity::show_disparity(Size image_size, headlessRunner &hr) {
+    // Capture both cameras on their own threads and pair frames grabbed at most 15 ms apart
+    // in headless mode the left and right videos are the first and second sources on the command line
+    syncCapture cap(15);
+    if(hr.is_headless()) {
+        cap.add_file(hr.source(0)); // left
+        cap.add_file(hr.source(1)); // right
+    }
+    else {
+        cap.add_camera(2, image_size); // left
+        cap.add_camera(1, image_size); // right
+    }
+    cap.start();
+    vector<Mat> frames;
+    Mat combo; // rectified left and right images side-by-side, reused for every frame
 
     min_disp = 30;
     num_disp = ((image_size.width / 8) + 15) & -16;
     
-    namedWindow("Disparity", CV_WINDOW_NORMAL);
-    namedWindow("Left", CV_WINDOW_NORMAL);
-    createTrackbar("minDisparity + 30", "Disparity", &min_disp, 60, on_minDisp, (void *)this);
-    createTrackbar("numDisparity", "Disparity", &num_disp, 150, on_numDisp, (void *)this);
-
-    on_minDisp(min_disp, this);
-    on_numDisp(num_disp, this);
-
-    while(char(waitKey(1)) != 'q') {
-        //grab raw frames first
-        capl.grab();
-        capr.grab();
-        //decode later so the grabbed frames are less apart in time
-        Mat framel, framel_rect, framer, framer_rect;
-        capl.retrieve(framel);
-        capr.retrieve(framer);
-
-        if(framel.empty() || framer.empty()) break;
-
-        remap(framel, framel_rect, map_l1, map_l2, INTER_LINEAR);
-        remap(framer, framer_rect, map_r1, map_r2, INTER_LINEAR);
+    if(!hr.is_headless()) {
+        namedWindow("Disparity", CV_WINDOW_NORMAL);
+        namedWindow("Left", CV_WINDOW_NORMAL);
+        createTrackbar("minDisparity + 30", "Disparity", &min_disp, 60, on_minDisp, (void *)this);
+        createTrackbar("numDisparity", "Disparity", &num_disp, 150, on_numDisp, (void *)this);
+
+        on_minDisp(min_disp, this);
+        on_numDisp(num_disp, this);
+    }
+    else {
+        set_minDisp(min_disp - 30);
+        set_numDisp(num_disp);
+    }
+
+    // profiler ids of the stages, looked up once outside of the frame loop
+    const int capture_id = hr.stage_id("capture"), rectify_id = hr.stage_id("rectify"),
+              disparity_id = hr.stage_id("disparity"), display_id = hr.stage_id("display");
+
+    while(hr.next()) {
+        //wait for the next pair of frames grabbed close together in time
+        hr.stage(capture_id);
+        if(!cap.read(frames)) break;
+        Mat framel, framer;
+        framel = frames[0];
+        framer = frames[1];
+
+        hr.stage(rectify_id);
+        // both images are rectified in parallel into the halves of one preallocated buffer
+        maps.rectify(framel, framer, combo);
+        Mat framel_rect = combo.colRange(0, combo.cols / 2), framer_rect = combo.colRange(combo.cols / 2, combo.cols);
         
         // Calculate disparity
+        hr.stage(disparity_id);
         Mat disp, disp_show;
-        stereo(framel_rect, framer_rect, disp);
+        if(incremental) temporal(framel_rect, framer_rect, disp);
+        else stereo(framel_rect, framer_rect, disp);
         // Convert disparity to a form easy for visualization
+        hr.stage(display_id);
         disp.convertTo(disp_show, CV_8U, 255/(stereo.numberOfDisparities * 16.));
-        imshow("Disparity", disp_show);
-        imshow("Left", framel);
+        hr.show("Disparity", disp_show);
+        hr.show("Left", framel);
     }
-    capl.release();
-    capr.release();
+    cap.stop();
+    cap.print_stats();
+    if(incremental) temporal.print_stats();
 }
 
-int main() {
+int main(int argc, char **argv) {
+    // Run with --incremental to recompute disparity only for the parts of the scene that changed, and with
+    // [--incremental] --headless <left video> <right video> to benchmark without a display
+    bool incremental = argc > 1 && string(argv[1]) == "--incremental";
+    if(incremental) {
+        // headlessRunner expects --headless right after the program name
+        argv[1] = argv[0];
+        argc--;
+        argv++;
+    }
+    headlessRunner hr(argc, argv);
+
     string filename = DATA_FOLDER + string("stereo_calib.xml");
    
     Size image_size(320, 240);
-    disparity disp(filename, image_size);
-    disp.show_disparity(image_size);
+    disparity disp(filename, image_size, incremental);
+    disp.show_disparity(image_size, hr);
+    hr.report();
 
     return 0;
 }
@@ -5,17 +5,32 @@
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/calib3d/calib3d.hpp>
 #include "Config.h"
+#include <algorithm>
+#include "syncCapture.h"
+#include "mapCache.h"
+#include "stripSGBM.h"
+#include "temporalDisparity.h"
 
 using namespace cv;
 using namespace std;
 
+// Depth statistics of one region of the disparity map
+struct depthStats {
+    double mean, median; // Z in the units of the calibration (mm)
+    int valid; // number of pixels with a valid disparity
+};
+
 class disparity {
     private:
-        Mat map_l1, map_l2, map_r1, map_r2, Q;
-        StereoSGBM stereo;
+        mapCache maps;
+        stripSGBM stereo;
+        temporalDisparity temporal;
+        bool incremental;
         int min_disp, num_disp;
     public:
-        disparity(string, Size);
+        disparity(string, Size, bool);
+        // Depth of the pixels inside each ROI, computed directly from the CV_16S disparity map and Q
+        vector<depthStats> depth(const Mat &disp, const vector<Rect> &rois);
         void set_minDisp(int minDisp) { stereo.minDisparity = minDisp; }
         void set_numDisp(int numDisp) { stereo.numberOfDisparities = numDisp; }
         void show_disparity(Size);
@@ -33,15 +48,10 @@ void on_numDisp(int num_disp, void * _disp_obj) {
     disp_obj -> set_numDisp(num_disp);
 }
 
-disparity::disparity(string filename, Size image_size) {
-    FileStorage fs(filename, FileStorage::READ);
-    fs["map_l1"] >> map_l1;
-    fs["map_l2"] >> map_l2;
-    fs["map_r1"] >> map_r1;
-    fs["map_r2"] >> map_r2;
-    fs["Q"] >> Q;
+disparity::disparity(string filename, Size image_size, bool _incremental) : temporal(&stereo) {
+    incremental = _incremental;
 
-    if(map_l1.empty() || map_l2.empty() || map_r1.empty() || map_r2.empty() || Q.empty())
+    if(!maps.open(filename, image_size))
         cout << "WARNING: Loading of mapping matrices not successful" << endl;
 
     stereo.preFilterCap = 63;
@@ -56,12 +66,13 @@ disparity::disparity(string filename, Size image_size) {
 }
 
 void disparity::show_disparity(Size image_size) {
-    VideoCapture capr(1), capl(2);
-    //reduce frame size
-    capl.set(CV_CAP_PROP_FRAME_HEIGHT, image_size.height);
-    capl.set(CV_CAP_PROP_FRAME_WIDTH, image_size.width);
-    capr.set(CV_CAP_PROP_FRAME_HEIGHT, image_size.height);
-    capr.set(CV_CAP_PROP_FRAME_WIDTH, image_size.width);
+    // Capture both cameras on their own threads and pair frames grabbed at most 15 ms apart
+    syncCapture cap(15);
+    cap.add_camera(2, image_size); // left
+    cap.add_camera(1, image_size); // right
+    cap.start();
+    vector<Mat> frames;
+    Mat combo; // rectified left and right images side-by-side, reused for every frame
 
     min_disp = 30;
     num_disp = ((image_size.width / 8) + 15) & -16;
@@ -75,51 +86,85 @@ void disparity::show_disparity(Size image_size) {
     on_numDisp(num_disp, this);
 
     while(char(waitKey(1)) != 'q') {
-        //grab raw frames first
-        capl.grab();
-        capr.grab();
-        //decode later so the grabbed frames are less apart in time
-        Mat framel, framel_rect, framer, framer_rect;
-        capl.retrieve(framel);
-        capr.retrieve(framer);
-
-        if(framel.empty() || framer.empty()) break;
-
-        remap(framel, framel_rect, map_l1, map_l2, INTER_LINEAR);
-        remap(framer, framer_rect, map_r1, map_r2, INTER_LINEAR);
+        //wait for the next pair of frames grabbed close together in time
+        if(!cap.read(frames)) break;
+        Mat framel, framer;
+        framel = frames[0];
+        framer = frames[1];
+
+        // both images are rectified in parallel into the halves of one preallocated buffer
+        maps.rectify(framel, framer, combo);
+        Mat framel_rect = combo.colRange(0, combo.cols / 2), framer_rect = combo.colRange(combo.cols / 2, combo.cols);
         
-        Mat disp, disp_show, disp_compute, pointcloud;
-        stereo(framel_rect, framer_rect, disp);
+        Mat disp, disp_show;
+        if(incremental) temporal(framel_rect, framer_rect, disp);
+        else stereo(framel_rect, framer_rect, disp);
         disp.convertTo(disp_show, CV_8U, 255/(stereo.numberOfDisparities * 16.));
-        disp.convertTo(disp_compute, CV_32F, 1.f/16.f);
-
-        // Calculate 3D co-ordinates from disparity image
-        reprojectImageTo3D(disp_compute, pointcloud, Q, true);
 
         // Draw red rectangle around 40 px wide square area im image
-        int xmin = framel.cols/2 - 20, xmax = framel.cols/2 + 20, ymin = framel.rows/2 - 20, ymax = framel.rows/2 + 20;
-        rectangle(framel_rect, Point(xmin, ymin), Point(xmax, ymax), Scalar(0, 0, 255));
-
-        // Extract depth of 40 px rectangle and print out their mean
-        pointcloud = pointcloud(Range(ymin, ymax), Range(xmin, xmax));
-        Mat z_roi(pointcloud.size(), CV_32FC1);
-        int from_to[] = {2, 0};
-        mixChannels(&pointcloud, 1, &z_roi, 1, from_to, 1);
+        Rect target(framel.cols/2 - 20, framel.rows/2 - 20, 40, 40);
+        rectangle(framel_rect, target, Scalar(0, 0, 255));
 
-        cout << "Depth: " << mean(z_roi) << " mm" << endl;
+        // Calculate depth of the pixels in the rectangle only and print it out
+        vector<Rect> rois(1, target);
+        vector<depthStats> d = depth(disp, rois);
+        cout << "Depth: " << d[0].mean << " mm mean, " << d[0].median << " mm median, " << d[0].valid << " valid pixels" << endl;
 
         imshow("Disparity", disp_show);
         imshow("Left", framel_rect);
     }
-    capl.release();
-    capr.release();
+    cap.stop();
+    cap.print_stats();
+    if(incremental) temporal.print_stats();
 }
 
-int main() {
+vector<depthStats> disparity::depth(const Mat &disp, const vector<Rect> &rois) {
+    // Reprojection by Q: [X Y Z W]' = Q * [x y d 1]', depth = Z / W. Only the third and fourth rows are needed
+    const Mat_<double> Q = maps.Q;
+    double q20 = Q(2, 0), q21 = Q(2, 1), q22 = Q(2, 2), q23 = Q(2, 3);
+    double q30 = Q(3, 0), q31 = Q(3, 1), q32 = Q(3, 2), q33 = Q(3, 3);
+    // StereoSGBM stores disparity * 16 and marks pixels without a match with (minDisparity - 1) * 16
+    int invalid = (stereo.minDisparity - 1) * StereoSGBM::DISP_SCALE;
+
+    vector<depthStats> stats(rois.size());
+    vector<float> z;
+    for(int i = 0; i < rois.size(); i++) {
+        Rect roi = rois[i] & Rect(0, 0, disp.cols, disp.rows);
+        z.clear();
+        double sum = 0;
+        for(int y = roi.y; y < roi.y + roi.height; y++) {
+            const short *d = disp.ptr<short>(y);
+            for(int x = roi.x; x < roi.x + roi.width; x++) {
+                if(d[x] <= invalid) continue;
+                double disp_px = d[x] / double(StereoSGBM::DISP_SCALE);
+                double W = q30 * x + q31 * y + q32 * disp_px + q33;
+                if(W == 0) continue;
+                double Z = (q20 * x + q21 * y + q22 * disp_px + q23) / W;
+                if(Z <= 0) continue;
+                z.push_back(Z);
+                sum += Z;
+            }
+        }
+
+        stats[i].valid = z.size();
+        stats[i].mean = z.empty() ? 0 : sum / z.size();
+        stats[i].median = 0;
+        if(!z.empty()) {
+            nth_element(z.begin(), z.begin() + z.size() / 2, z.end());
+            stats[i].median = z[z.size() / 2];
+        }
+    }
+    return stats;
+}
+
+int main(int argc, char **argv) {
+    // Run with --incremental to recompute disparity only for the parts of the scene that changed
+    bool incremental = argc > 1 && string(argv[1]) == "--incremental";
+
     string filename = DATA_FOLDER + string("stereo_calib.xml");
    
     Size image_size(320, 240);
-    disparity disp(filename, image_size);
+    disparity disp(filename, image_size, incremental);
     disp.show_disparity(image_size);
 
     return 0;
@@ -0,0 +1,237 @@
+// Binary cache of the stereo rectification maps
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "mapCache.h"
+
+using namespace cv;
+using namespace std;
+
+// File layout: a fixed size header holding the key, the image size and the type, size and offset of every matrix,
+// followed by the raw matrix data, each matrix starting at a multiple of 64 bytes
+// Matrices in order: map_l1, map_l2, map_r1, map_r2, Rl, Rr, Pl, Pr, Q
+static const int N_MATS = 9;
+static const char MAGIC[8] = {'R', 'E', 'C', 'T', 'M', 'A', 'P', '1'};
+
+struct cacheHeader {
+    char magic[8];
+    unsigned long long key;
+    int width, height, n, reserved;
+    struct {
+        int rows, cols, type, reserved;
+        unsigned long long offset; // from the start of the file
+    } mats[N_MATS];
+};
+
+static void fnv1a(unsigned long long &h, const void *data, size_t n) {
+    const unsigned char *p = (const unsigned char *)data;
+    for(size_t i = 0; i < n; i++) {
+        h ^= p[i];
+        h *= 1099511628211ULL;
+    }
+}
+
+unsigned long long mapCache::hash(const vector<Mat> &params, Size image_size) {
+    unsigned long long h = 14695981039346656037ULL;
+    fnv1a(h, MAGIC, sizeof(MAGIC));
+    fnv1a(h, &image_size.width, sizeof(int));
+    fnv1a(h, &image_size.height, sizeof(int));
+    for(int i = 0; i < params.size(); i++) {
+        Mat m = params[i].isContinuous() ? params[i] : params[i].clone();
+        int info[3] = {m.type(), m.rows, m.cols};
+        fnv1a(h, info, sizeof(info));
+        fnv1a(h, m.data, m.total() * m.elemSize());
+    }
+    return h;
+}
+
+string mapCache::cache_filename(const string &calib_filename) {
+    size_t dot = calib_filename.rfind('.'), slash = calib_filename.find_last_of("/\\");
+    if(dot == string::npos || (slash != string::npos && dot < slash)) return calib_filename + ".maps";
+    return calib_filename.substr(0, dot) + ".maps";
+}
+
+mapCache::mapCache() {
+    mapping = NULL;
+    length = 0;
+    regenerated = false;
+}
+
+mapCache::~mapCache() {
+    unmap();
+}
+
+void mapCache::unmap() {
+    // drop the headers before the memory they point to
+    assign(vector<Mat>(N_MATS));
+    if(mapping) munmap(mapping, length);
+    mapping = NULL;
+    length = 0;
+}
+
+void mapCache::assign(const vector<Mat> &mats) {
+    Mat *m[N_MATS] = {&map_l1, &map_l2, &map_r1, &map_r2, &Rl, &Rr, &Pl, &Pr, &Q};
+    for(int i = 0; i < N_MATS; i++) *m[i] = mats[i];
+}
+
+bool mapCache::open(const string &calib_filename, Size image_size) {
+    unmap();
+    regenerated = false;
+
+    // Read individual camera calibration information and the stereo extrinsics
+    vector<Mat> params(6);
+    FileStorage fs(calib_filename, FileStorage::READ);
+    fs["l_cameraMatrix"] >> params[0];
+    fs["l_distCoeffs"] >> params[1];
+    fs["r_cameraMatrix"] >> params[2];
+    fs["r_distCoeffs"] >> params[3];
+    fs["R"] >> params[4];
+    fs["T"] >> params[5];
+    fs.release();
+    for(int i = 0; i < params.size(); i++) {
+        if(params[i].empty()) {
+            cout << "mapCache: Loading of calibration parameters from " << calib_filename << " not successful" << endl;
+            return false;
+        }
+    }
+
+    unsigned long long key = hash(params, image_size);
+    string path = cache_filename(calib_filename);
+    if(load(path, key, image_size)) return true;
+
+    cout << "mapCache: Calibration changed or no cache found, computing rectification maps" << endl;
+    vector<Mat> mats;
+    compute(params, image_size, mats);
+    regenerated = true;
+    if(save(path, key, image_size, mats) && load(path, key, image_size)) return true;
+
+    // the data folder may be read-only, use the maps computed in memory
+    cout << "mapCache: Could not write " << path << ", rectification maps will be recomputed on the next run" << endl;
+    assign(mats);
+    return true;
+}
+
+void mapCache::compute(const vector<Mat> &params, Size image_size, vector<Mat> &mats) {
+    mats.assign(N_MATS, Mat());
+    // Calculate transforms for rectifying images
+    stereoRectify(params[0], params[1], params[2], params[3], image_size, params[4], params[5], mats[4], mats[5], mats[6], mats[7], mats[8]);
+
+    // Calculate pixel maps for efficient rectification of images via lookup tables
+    initUndistortRectifyMap(params[0], params[1], mats[4], mats[6], image_size, CV_16SC2, mats[0], mats[1]);
+    initUndistortRectifyMap(params[2], params[3], mats[5], mats[7], image_size, CV_16SC2, mats[2], mats[3]);
+}
+
+bool mapCache::save(const string &path, unsigned long long key, Size image_size, const vector<Mat> &mats) {
+    cacheHeader h;
+    memset(&h, 0, sizeof(h));
+    memcpy(h.magic, MAGIC, sizeof(MAGIC));
+    h.key = key;
+    h.width = image_size.width;
+    h.height = image_size.height;
+    h.n = N_MATS;
+    unsigned long long offset = sizeof(h);
+    for(int i = 0; i < N_MATS; i++) {
+        offset = (offset + 63) & ~63ULL;
+        h.mats[i].rows = mats[i].rows;
+        h.mats[i].cols = mats[i].cols;
+        h.mats[i].type = mats[i].type();
+        h.mats[i].offset = offset;
+        offset += mats[i].total() * mats[i].elemSize();
+    }
+
+    // write to a temporary file and rename it, so that a program starting meanwhile never maps half a file
+    string tmp_path = path + ".tmp";
+    ofstream out(tmp_path.c_str(), ios::binary | ios::trunc);
+    if(!out.is_open()) return false;
+    out.write((const char *)&h, sizeof(h));
+    unsigned long long pos = sizeof(h);
+    const char zeros[64] = {0};
+    for(int i = 0; i < N_MATS; i++) {
+        out.write(zeros, h.mats[i].offset - pos);
+        Mat m = mats[i].isContinuous() ? mats[i] : mats[i].clone();
+        out.write((const char *)m.data, m.total() * m.elemSize());
+        pos = h.mats[i].offset + m.total() * m.elemSize();
+    }
+    out.close();
+    if(out.fail() || rename(tmp_path.c_str(), path.c_str()) != 0) {
+        remove(tmp_path.c_str());
+        return false;
+    }
+    return true;
+}
+
+bool mapCache::load(const string &path, unsigned long long key, Size image_size) {
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(cacheHeader)) {
+        close(fd);
+        return false;
+    }
+    size_t size = st.st_size;
+    void *p = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if(p == MAP_FAILED) return false;
+
+    // reject caches of other calibrations or image sizes, and truncated files
+    const cacheHeader *h = (const cacheHeader *)p;
+    bool valid = memcmp(h->magic, MAGIC, sizeof(MAGIC)) == 0 && h->key == key && h->n == N_MATS &&
+                 h->width == image_size.width && h->height == image_size.height;
+    for(int i = 0; valid && i < N_MATS; i++) {
+        unsigned long long bytes = (unsigned long long)h->mats[i].rows * h->mats[i].cols * CV_ELEM_SIZE(h->mats[i].type);
+        valid = h->mats[i].rows > 0 && h->mats[i].cols > 0 && h->mats[i].offset % 64 == 0 && h->mats[i].offset + bytes <= size;
+    }
+    if(!valid) {
+        munmap(p, size);
+        return false;
+    }
+
+    // wrap the mapped data in Mat headers, nothing is copied
+    vector<Mat> mats(N_MATS);
+    for(int i = 0; i < N_MATS; i++)
+        mats[i] = Mat(h->mats[i].rows, h->mats[i].cols, h->mats[i].type, (char *)p + h->mats[i].offset);
+    mapping = p;
+    length = size;
+    assign(mats);
+    return true;
+}
+
+// Remaps row bands of the left and right images into their halves of the side-by-side output
+class rectifyBands : public ParallelLoopBody {
+    private:
+        const Mat *src[2], *map1[2], *map2[2];
+        Mat dst;
+        int bands; // per image
+    public:
+        rectifyBands(const Mat &left, const Mat &right, const mapCache &maps, Mat &combo, int _bands) {
+            src[0] = &left; src[1] = &right;
+            map1[0] = &maps.map_l1; map1[1] = &maps.map_r1;
+            map2[0] = &maps.map_l2; map2[1] = &maps.map_r2;
+            dst = combo;
+            bands = _bands;
+        }
+        void operator()(const Range &r) const {
+            int w = dst.cols / 2;
+            for(int b = r.start; b < r.end; b++) {
+                int side = b / bands, band = b % bands;
+                int y0 = dst.rows * band / bands, y1 = dst.rows * (band + 1) / bands;
+                // the maps hold absolute source co-ordinates, so a band of the maps rectifies a band of the output
+                Mat out = dst(Range(y0, y1), Range(side * w, (side + 1) * w));
+                remap(*src[side], out, map1[side]->rowRange(y0, y1), map2[side]->rowRange(y0, y1), INTER_LINEAR);
+            }
+        }
+};
+
+void mapCache::rectify(const Mat &left, const Mat &right, Mat &combo) const {
+    combo.create(map_l1.rows, 2 * map_l1.cols, left.type());
+    // a few bands per thread so that the two images share the threads evenly
+    int bands = max(1, min(combo.rows, 2 * getNumThreads()));
+    parallel_for_(Range(0, 2 * bands), rectifyBands(left, right, *this, combo, bands));
+}
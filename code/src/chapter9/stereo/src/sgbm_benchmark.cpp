@@ -0,0 +1,101 @@
+// Program to benchmark strip-parallel SGBM for different strip counts and check it against single-threaded StereoSGBM
+// Run as ./sgbm_benchmark [left image] [right image], by default the first calibration pair is used.
+// Returns 1 if the disparity of any strip count differs from the single-threaded one at too many pixels
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <iomanip>
+#include "Config.h"
+#include "mapCache.h"
+#include "stripSGBM.h"
+
+using namespace cv;
+using namespace std;
+
+// Set SGBM parameters like code9-6 and code9-7
+void set_params(StereoSGBM &stereo, Size image_size) {
+    stereo.minDisparity = 0;
+    stereo.numberOfDisparities = ((image_size.width / 8) + 15) & -16;
+    stereo.preFilterCap = 63;
+    stereo.SADWindowSize = 3;
+    stereo.P1 = 8 * 3 * stereo.SADWindowSize * stereo.SADWindowSize;
+    stereo.P2 = 32 * 3 * stereo.SADWindowSize * stereo.SADWindowSize;
+    stereo.uniquenessRatio = 10;
+    stereo.speckleWindowSize = 100;
+    stereo.speckleRange = 32;
+    stereo.disp12MaxDiff = 1;
+    stereo.fullDP = true;
+}
+
+// Fraction of pixels whose disparity differs by more than 1 px, or which are matched in only one of the maps
+double mismatch(const Mat &disp, const Mat &ref, int invalid) {
+    int count = 0;
+    for(int y = 0; y < ref.rows; y++) {
+        const short *d = disp.ptr<short>(y), *r = ref.ptr<short>(y);
+        for(int x = 0; x < ref.cols; x++) {
+            bool dv = d[x] > invalid, rv = r[x] > invalid;
+            if(dv != rv || (dv && abs(d[x] - r[x]) > StereoSGBM::DISP_SCALE)) count++;
+        }
+    }
+    return double(count) / ref.total();
+}
+
+int main(int argc, char **argv) {
+    string l_name = argc > 2 ? argv[1] : string(LEFT_FOLDER) + "left0000.jpg";
+    string r_name = argc > 2 ? argv[2] : string(RIGHT_FOLDER) + "right0000.jpg";
+    Mat left = imread(l_name), right = imread(r_name);
+    if(left.empty() || right.empty()) {
+        cout << "Could not read " << l_name << " and " << r_name << endl;
+        return -1;
+    }
+
+    // Rectify the pair if there is a calibration for this image size
+    mapCache maps;
+    Mat combo;
+    if(maps.open(DATA_FOLDER + string("stereo_calib.xml"), left.size())) {
+        maps.rectify(left, right, combo);
+        left = combo.colRange(0, combo.cols / 2);
+        right = combo.colRange(combo.cols / 2, combo.cols);
+    }
+
+    // change if you want
+    int runs = 20;
+    double max_mismatch = 0.01; // largest fraction of differing pixels allowed
+    int strip_counts[] = {1, 2, 3, 4, 6, 8, 12, 16};
+
+    // Reference: single-threaded StereoSGBM over the whole pair
+    StereoSGBM reference;
+    set_params(reference, left.size());
+    Mat ref;
+    reference(left, right, ref);
+    double t0 = getTickCount();
+    for(int i = 0; i < runs; i++) reference(left, right, ref);
+    double ref_ms = 1000 * (getTickCount() - t0) / getTickFrequency() / runs;
+    int invalid = (reference.minDisparity - 1) * StereoSGBM::DISP_SCALE;
+
+    cout << "Image size " << left.cols << "x" << left.rows << ", " << getNumThreads() << " threads, " << runs << " runs each" << endl;
+    cout << setw(8) << "strips" << setw(12) << "ms/pair" << setw(10) << "speedup" << setw(14) << "mismatch %" << endl;
+    cout << setw(8) << "ref" << setw(12) << ref_ms << setw(10) << 1. << setw(14) << 0. << endl;
+
+    bool pass = true;
+    for(int s = 0; s < sizeof(strip_counts) / sizeof(strip_counts[0]); s++) {
+        stripSGBM stereo(strip_counts[s]);
+        set_params(stereo, left.size());
+        if(stereo.get_strips(left.rows) != strip_counts[s]) continue; // too thin for their context
+
+        Mat disp;
+        stereo(left, right, disp); // first call allocates the buffers
+        t0 = getTickCount();
+        for(int i = 0; i < runs; i++) stereo(left, right, disp);
+        double ms = 1000 * (getTickCount() - t0) / getTickFrequency() / runs;
+
+        double m = mismatch(disp, ref, invalid);
+        if(m > max_mismatch) pass = false;
+        cout << setw(8) << strip_counts[s] << setw(12) << ms << setw(10) << ref_ms / ms << setw(14) << 100 * m
+             << (m > max_mismatch ? "  FAIL" : "") << endl;
+    }
+
+    cout << (pass ? "All strip counts within " : "Seams differ by more than ") << 100 * max_mismatch << "% of pixels from the reference" << endl;
+    return pass ? 0 : 1;
+}
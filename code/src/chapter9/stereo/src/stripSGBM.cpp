@@ -0,0 +1,79 @@
+// Strip-parallel semi-global block matching
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <cmath>
+#include "stripSGBM.h"
+
+using namespace cv;
+using namespace std;
+
+// Matches every strip with its context rows and copies the strip's own rows into the output
+class matchStrips : public ParallelLoopBody {
+    private:
+        Mat left, right, disp;
+        vector<StereoSGBM> *matchers;
+        int n, overlap;
+    public:
+        matchStrips(const Mat &_left, const Mat &_right, Mat &_disp, vector<StereoSGBM> *_matchers, int _overlap) {
+            left = _left; right = _right; disp = _disp;
+            matchers = _matchers;
+            n = matchers->size();
+            overlap = _overlap;
+        }
+        void operator()(const Range &r) const {
+            for(int i = r.start; i < r.end; i++) {
+                int y0 = left.rows * i / n, y1 = left.rows * (i + 1) / n;
+                int a = max(0, y0 - overlap), b = min(left.rows, y1 + overlap);
+                Mat part;
+                (*matchers)[i](left.rowRange(a, b), right.rowRange(a, b), part);
+                part.rowRange(y0 - a, y1 - a).copyTo(disp.rowRange(y0, y1));
+            }
+        }
+};
+
+stripSGBM::stripSGBM(int _strips, int _smoothing_rows) {
+    strips = _strips;
+    smoothing_rows = _smoothing_rows;
+}
+
+int stripSGBM::overlap() const {
+    // the SAD window radius, the smoothing context and enough rows for a speckle region to be seen whole
+    return SADWindowSize / 2 + smoothing_rows + int(ceil(sqrt(double(max(speckleWindowSize, 0)))));
+}
+
+int stripSGBM::get_strips(int rows) const {
+    int n = strips > 0 ? strips : getNumThreads();
+    // strips much thinner than their context only add work
+    return max(1, min(n, rows / max(1, overlap())));
+}
+
+void stripSGBM::operator()(InputArray _left, InputArray _right, OutputArray _disp) {
+    Mat left = _left.getMat(), right = _right.getMat();
+    int n = get_strips(left.rows);
+    if(n == 1) {
+        StereoSGBM::operator()(left, right, _disp);
+        return;
+    }
+
+    _disp.create(left.size(), CV_16S);
+    Mat disp = _disp.getMat();
+
+    // parameters may have been changed since the last frame (by trackbars), pass them on to every strip
+    matchers.resize(n);
+    for(int i = 0; i < n; i++) {
+        StereoSGBM &m = matchers[i];
+        m.minDisparity = minDisparity;
+        m.numberOfDisparities = numberOfDisparities;
+        m.SADWindowSize = SADWindowSize;
+        m.preFilterCap = preFilterCap;
+        m.uniquenessRatio = uniquenessRatio;
+        m.P1 = P1;
+        m.P2 = P2;
+        m.speckleWindowSize = speckleWindowSize;
+        m.speckleRange = speckleRange;
+        m.disp12MaxDiff = disp12MaxDiff;
+        m.fullDP = fullDP;
+    }
+    parallel_for_(Range(0, n), matchStrips(left, right, disp, &matchers, overlap()));
+}
@@ -0,0 +1,209 @@
+// Synchronized capture from N cameras (or videos standing in for them)
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <cmath>
+#include "syncCapture.h"
+
+using namespace cv;
+using namespace std;
+
+syncCapture::syncCapture(double _tolerance, int _queue_size) {
+    tolerance = _tolerance;
+    queue_size = max(1, _queue_size);
+    running = false;
+    bundles = 0;
+    skew_sum = skew_max = 0;
+}
+
+syncCapture::~syncCapture() {
+    stop();
+    for(int i = 0; i < streams.size(); i++) delete streams[i];
+}
+
+double syncCapture::now() {
+    return 1000. * getTickCount() / getTickFrequency();
+}
+
+int syncCapture::add_camera(int id, Size size) {
+    stream *s = new stream;
+    s->cap.open(id);
+    s->cap.set(CV_CAP_PROP_FRAME_HEIGHT, size.height);
+    s->cap.set(CV_CAP_PROP_FRAME_WIDTH, size.width);
+    if(!s->cap.isOpened()) cout << "syncCapture: could not open camera " << id << endl;
+    s->is_file = false;
+    s->period = s->offset = 0;
+    s->finished = false;
+    s->captured = s->overflow_drops = s->unmatched_drops = 0;
+    streams.push_back(s);
+    return streams.size() - 1;
+}
+
+int syncCapture::add_file(const string &filename, double fps, double offset_ms) {
+    stream *s = new stream;
+    s->cap.open(filename);
+    if(!s->cap.isOpened()) cout << "syncCapture: could not open " << filename << endl;
+    s->is_file = true;
+    s->period = fps > 0 ? 1000. / fps : 0;
+    s->offset = offset_ms;
+    s->finished = false;
+    s->captured = s->overflow_drops = s->unmatched_drops = 0;
+    streams.push_back(s);
+    return streams.size() - 1;
+}
+
+void syncCapture::start() {
+    if(running) return;
+    running = true;
+    for(int i = 0; i < streams.size(); i++)
+        threads.add_thread(new boost::thread(&syncCapture::run, this, streams[i]));
+}
+
+void syncCapture::stop() {
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        if(!running) return;
+        running = false;
+    }
+    space.notify_all();
+    threads.join_all();
+}
+
+void syncCapture::run(stream *s) {
+    // nominal frame period of the file, used to timestamp files read as fast as possible
+    double file_period = 1000. / 30;
+    if(s->is_file && s->cap.get(CV_CAP_PROP_FPS) > 0) file_period = 1000. / s->cap.get(CV_CAP_PROP_FPS);
+
+    double t_start = now();
+    for(unsigned long n = 0; ; n++) {
+        if(s->is_file && s->period > 0) {
+            // play back in real time, delayed by the offset like a camera that started later
+            double wait = t_start + s->offset + n * s->period - now();
+            if(wait > 0) boost::this_thread::sleep(boost::posix_time::microseconds((long)(wait * 1000)));
+        }
+
+        // grab first and timestamp immediately, decoding can take a while
+        if(!s->cap.grab()) break;
+        double t;
+        if(!s->is_file || s->period > 0) t = now() + s->offset;
+        else t = n * file_period + s->offset;
+
+        Mat frame;
+        s->cap.retrieve(frame);
+        if(frame.empty()) break;
+
+        boost::unique_lock<boost::mutex> lock(mtx);
+        if(!running) break;
+        if(s->q.size() >= queue_size) {
+            if(s->is_file && s->period == 0) {
+                // nothing is lost by waiting for the reader
+                while(s->q.size() >= queue_size && running) space.wait(lock);
+                if(!running) break;
+            }
+            else {
+                // a camera keeps going, throw away the oldest frame
+                s->q.pop_front();
+                s->overflow_drops++;
+            }
+        }
+        s->q.push_back(make_pair(t, frame));
+        s->captured++;
+        lock.unlock();
+        new_frame.notify_all();
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        s->finished = true;
+    }
+    new_frame.notify_all();
+}
+
+bool syncCapture::read(vector<Mat> &frames, vector<double> *timestamps) {
+    if(streams.empty()) return false;
+    boost::unique_lock<boost::mutex> lock(mtx);
+    while(true) {
+        // wait till every stream has a frame
+        bool ready = true;
+        for(int i = 0; i < streams.size(); i++) {
+            if(streams[i]->q.empty()) {
+                if(streams[i]->finished) return false;
+                ready = false;
+            }
+        }
+        if(!ready) {
+            new_frame.wait(lock);
+            continue;
+        }
+
+        // The newest of the oldest queued frames is the earliest time every stream can have a frame at.
+        // Frames more than 'tolerance' older than that cannot be part of any bundle any more
+        double T = streams[0]->q.front().first;
+        for(int i = 1; i < streams.size(); i++) T = max(T, streams[i]->q.front().first);
+        bool dropped = false;
+        for(int i = 0; i < streams.size(); i++) {
+            stream *s = streams[i];
+            while(!s->q.empty() && s->q.front().first < T - tolerance) {
+                s->q.pop_front();
+                s->unmatched_drops++;
+                dropped = true;
+            }
+        }
+        if(dropped) {
+            space.notify_all();
+            continue;
+        }
+
+        // All oldest frames are now within [T - tolerance, T]. In every stream pick the frame closest to T,
+        // and fall back to the latest frame not after T if that makes the bundle too wide
+        vector<int> pick(streams.size()), safe(streams.size());
+        double t_min = T, t_max = T;
+        for(int i = 0; i < streams.size(); i++) {
+            deque<pair<double, Mat> > &q = streams[i]->q;
+            int k = 0;
+            while(k + 1 < q.size() && q[k + 1].first <= T) k++;
+            safe[i] = k;
+            if(k + 1 < q.size() && fabs(q[k + 1].first - T) < fabs(q[k].first - T)) k++;
+            pick[i] = k;
+            t_min = min(t_min, q[k].first);
+            t_max = max(t_max, q[k].first);
+        }
+        if(t_max - t_min > tolerance) {
+            pick = safe;
+            t_min = t_max = T;
+            for(int i = 0; i < streams.size(); i++) {
+                t_min = min(t_min, streams[i]->q[pick[i]].first);
+                t_max = max(t_max, streams[i]->q[pick[i]].first);
+            }
+        }
+
+        // hand out the bundle and discard the frames before it
+        frames.resize(streams.size());
+        if(timestamps) timestamps->resize(streams.size());
+        for(int i = 0; i < streams.size(); i++) {
+            stream *s = streams[i];
+            s->unmatched_drops += pick[i];
+            s->q.erase(s->q.begin(), s->q.begin() + pick[i]);
+            frames[i] = s->q.front().second;
+            if(timestamps) (*timestamps)[i] = s->q.front().first;
+            s->q.pop_front();
+        }
+        bundles++;
+        skew_sum += t_max - t_min;
+        skew_max = max(skew_max, t_max - t_min);
+        lock.unlock();
+        space.notify_all();
+        return true;
+    }
+}
+
+void syncCapture::print_stats() {
+    boost::unique_lock<boost::mutex> lock(mtx);
+    cout << "Synchronized bundles: " << bundles << endl;
+    cout << "Skew: " << (bundles ? skew_sum / bundles : 0.) << " ms average, " << skew_max << " ms maximum (tolerance " << tolerance << " ms)" << endl;
+    for(int i = 0; i < streams.size(); i++) {
+        stream *s = streams[i];
+        cout << "Stream " << i << ": " << s->captured << " captured, " << s->overflow_drops << " dropped because the queue was full, "
+             << s->unmatched_drops << " dropped because they could not be paired" << endl;
+    }
+}
@@ -0,0 +1,104 @@
+// Incremental disparity for a fixed stereo rig
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+#include "temporalDisparity.h"
+
+using namespace cv;
+using namespace std;
+
+temporalDisparity::temporalDisparity(stripSGBM *_stereo, int _tile, double _threshold, int _margin, int _refresh) {
+    stereo = _stereo;
+    tile = max(1, _tile);
+    threshold = _threshold;
+    margin = max(0, _margin);
+    refresh = _refresh;
+    cached_min_disp = cached_num_disp = -1;
+    frames = full_frames = 0;
+    fraction = fraction_sum = 0;
+}
+
+void temporalDisparity::full(const Mat &left, const Mat &right) {
+    (*stereo)(left, right, cache);
+    full_frames++;
+    fraction = 1;
+}
+
+void temporalDisparity::update(const Mat &left, const Mat &right, Rect region) {
+    // A left pixel at x is matched against right pixels from x - minDisparity - numberOfDisparities + 1 to
+    // x - minDisparity, so the region is extended horizontally by the disparity range and the SAD window,
+    // and vertically by the context rows the strips use
+    int sad = stereo->SADWindowSize / 2;
+    int ext_l = max(0, stereo->minDisparity + stereo->numberOfDisparities) + sad;
+    int ext_r = max(0, -stereo->minDisparity) + sad;
+    int ov = stereo->overlap();
+    Rect in(region.x - ext_l, region.y - ov, region.width + ext_l + ext_r, region.height + 2 * ov);
+    in &= Rect(0, 0, left.cols, left.rows);
+
+    Mat part;
+    (*stereo)(left(in), right(in), part);
+    part(Rect(region.x - in.x, region.y - in.y, region.width, region.height)).copyTo(cache(region));
+    fraction += double(region.area()) / cache.total();
+}
+
+void temporalDisparity::operator()(const Mat &left, const Mat &right, Mat &disp) {
+    // the caller may reuse the buffer of 'left', so keep a gray copy of it
+    Mat gray;
+    if(left.channels() == 3) cvtColor(left, gray, CV_BGR2GRAY);
+    else gray = left.clone();
+
+    bool full_frame = cache.size() != left.size() || prev_gray.size() != gray.size() ||
+                      stereo->minDisparity != cached_min_disp || stereo->numberOfDisparities != cached_num_disp ||
+                      (refresh > 0 && frames % refresh == 0);
+    if(!full_frame) {
+        // Mean absolute difference of every tile to the previous frame, the area interpolation of resize()
+        // averages the tiles in one cheap pass
+        Mat diff, tile_diff, changed;
+        absdiff(gray, prev_gray, diff);
+        Size grid((gray.cols + tile - 1) / tile, (gray.rows + tile - 1) / tile);
+        resize(diff, tile_diff, grid, 0, 0, INTER_AREA);
+        changed = tile_diff > threshold;
+        // grow the changed area by the margin, one tile per iteration of a 3x3 dilation
+        int grow = (margin + tile - 1) / tile;
+        if(grow > 0) dilate(changed, changed, Mat(), Point(-1, -1), grow);
+
+        // matching most of the frame in pieces costs more than matching it at once
+        if(countNonZero(changed) > changed.total() / 2) full_frame = true;
+        else {
+            fraction = 0;
+            // merge runs of tile rows with changes into one region spanning all their changed columns
+            for(int ty = 0; ty < grid.height; ty++) {
+                int c0 = grid.width, c1 = -1, t0 = ty;
+                for(; ty < grid.height; ty++) {
+                    const uchar *row = changed.ptr<uchar>(ty);
+                    int first = -1, last = -1;
+                    for(int tx = 0; tx < grid.width; tx++) {
+                        if(row[tx]) {
+                            if(first < 0) first = tx;
+                            last = tx;
+                        }
+                    }
+                    if(first < 0) break;
+                    c0 = min(c0, first);
+                    c1 = max(c1, last);
+                }
+                if(c1 < 0) continue;
+                Rect region(c0 * tile, t0 * tile, (c1 + 1 - c0) * tile, (ty - t0) * tile);
+                update(left, right, region & Rect(0, 0, left.cols, left.rows));
+            }
+        }
+    }
+    if(full_frame) full(left, right);
+
+    prev_gray = gray;
+    cached_min_disp = stereo->minDisparity;
+    cached_num_disp = stereo->numberOfDisparities;
+    frames++;
+    fraction_sum += fraction;
+    cache.copyTo(disp);
+}
+
+void temporalDisparity::print_stats() {
+    cout << "Temporal disparity: " << frames << " frames, " << full_frames << " matched in full, "
+         << 100 * mean_fraction() << "% of the area recomputed on average" << endl;
+}
@@ -0,0 +1,30 @@
+// Count of the heap allocations made through operator new, for the benchmarks that check code is allocation free
+// The global operator new and new[] are replaced by versions that count their calls. Only allocations made through
+// them are seen: cv::Mat buffers (fastMalloc()) and plain malloc() calls are not counted, and neither are Eigen's
+// (benchmarks using Eigen should also define EIGEN_RUNTIME_NO_MALLOC). Replacement operators cannot be inline, so
+// include this header in one translation unit of a program only
+
+#ifndef ALLOC_COUNTER_H
+#define ALLOC_COUNTER_H
+
+#include <cstdlib>
+#include <new>
+
+static unsigned long allocations = 0; // calls of operator new and new[] so far
+
+void *operator new(size_t size) {
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void *operator new[](size_t size) {
+    allocations++;
+    void *p = malloc(size ? size : 1);
+    if(!p) throw std::bad_alloc();
+    return p;
+}
+void operator delete(void *p) { free(p); }
+void operator delete[](void *p) { free(p); }
+
+#endif
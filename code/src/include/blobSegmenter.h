@@ -0,0 +1,221 @@
+// Fused colour thresholding, opening and closing
+// The blob detectors threshold a frame with inRange() and then open and close the mask with morphologyEx(), which
+// makes five passes over full size 8 bit images per frame, and they build the structuring element every frame.
+// blobSegmenter decomposes the element once, and does all of it in one pass over the frame:
+// - every row is thresholded (16 pixels at a time with SSE2) into a row of bits, 64 pixels per word
+// - the row is pushed through erode, dilate, dilate, erode stages. Each stage keeps only the last rows it needs in a
+//   ring (a few hundred bytes for a 640 pixel row), computes the horizontal lines of the element on each row once
+//   with word shifts and ANDs (ORs for dilation), and emits an output row as soon as the rows below it have arrived
+// - rows leaving the last stage are unpacked to 0 / 255 bytes
+// Pixels outside the image are ignored like in erode() and dilate(), so the mask is identical to that of the
+// inRange() and morphologyEx() chain
+
+#ifndef BLOB_SEGMENTER_H
+#define BLOB_SEGMENTER_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <vector>
+#include "morphologyEngine.h"
+
+// AND of bits for erosion
+struct bitAnd {
+    static uint64 fill() {return ~uint64(0);} // value of the bits outside the row
+    static uint64 apply(uint64 a, uint64 b) {return a & b;}
+};
+
+// OR of bits for dilation
+struct bitOr {
+    static uint64 fill() {return 0;}
+    static uint64 apply(uint64 a, uint64 b) {return a | b;}
+};
+
+// Bit x of out is bit x + s of in, bits outside in being fill. out must not be in
+inline void shift_bits(const uint64 *in, int in_words, uint64 *out, int out_words, int s, uint64 fill) {
+    int ws = s >= 0 ? s / 64 : -((63 - s) / 64), b = s - 64 * ws;
+    for(int w = 0; w < out_words; w++) {
+        int i = w + ws;
+        uint64 lo = i >= 0 && i < in_words ? in[i] : fill, hi = i + 1 >= 0 && i + 1 < in_words ? in[i + 1] : fill;
+        out[w] = b ? (lo >> b) | (hi << (64 - b)) : lo;
+    }
+}
+
+class blobSegmenter {
+    private:
+        std::vector<morphLine> lines; // rows of the structuring element
+        std::vector<int> lens; // distinct line lengths
+        int kh, lag; // element height, rows an output row waits for below it
+        int pad; // lines start up to pad pixels left of the pixel they belong to, so line rows start pad bits early
+        cv::Point anchor;
+
+        // frame being segmented
+        int rows, cols, words, line_words;
+        cv::Mat *mask;
+        std::vector<uint64> ring[4]; // lines of the last kh input rows of each stage, slot i % kh for row i
+        std::vector<uint64> out[4], tmp, line_tmp;
+
+        template<class Op> void push(int, int, uint64 *); // give input row i to a stage
+        template<class Op> void emit(int, int); // compute output row j of a stage and pass it on
+        void push_stage(int, int, uint64 *);
+        void emit_stage(int, int);
+        void threshold_row(const uchar *, int, const uchar *, const uchar *, uint64 *) const;
+    public:
+        blobSegmenter(const cv::Mat &strel, cv::Point _anchor = cv::Point(-1, -1));
+
+        // Mask of the pixels of an 8 bit image within [low, high] in every channel, opened and then closed
+        void segment(const cv::Mat &src, cv::Scalar low, cv::Scalar high, cv::Mat &dst);
+};
+
+inline blobSegmenter::blobSegmenter(const cv::Mat &strel, cv::Point _anchor) {
+    cv::Mat s;
+    strel.convertTo(s, CV_8U);
+    anchor = cv::Point(_anchor.x < 0 ? s.cols / 2 : _anchor.x, _anchor.y < 0 ? s.rows / 2 : _anchor.y);
+    CV_Assert(morph_lines(s, anchor, lines)); // every row of the element must be a single run
+    for(int l = 0; l < lines.size(); l++) lens.push_back(lines[l].len);
+    std::sort(lens.begin(), lens.end());
+    lens.erase(std::unique(lens.begin(), lens.end()), lens.end());
+    for(int l = 0; l < lines.size(); l++) lines[l].index = std::lower_bound(lens.begin(), lens.end(), lines[l].len) - lens.begin();
+    kh = s.rows;
+    lag = kh - 1 - anchor.y;
+    pad = 0;
+    for(int l = 0; l < lines.size(); l++) pad = std::max(pad, -lines[l].dx);
+    rows = cols = words = 0;
+    mask = 0;
+}
+
+// Stage 0 erodes, 1 and 2 dilate, 3 erodes
+inline void blobSegmenter::push_stage(int stage, int i, uint64 *row) {
+    if(stage == 0 || stage == 3) push<bitAnd>(stage, i, row);
+    else push<bitOr>(stage, i, row);
+}
+
+inline void blobSegmenter::emit_stage(int stage, int j) {
+    if(stage == 0 || stage == 3) emit<bitAnd>(stage, j);
+    else emit<bitOr>(stage, j);
+}
+
+template<class Op> inline void blobSegmenter::push(int stage, int i, uint64 *row) {
+    // bits past the end of the row are ignored
+    if(cols % 64) row[words - 1] = (row[words - 1] & ((uint64(1) << (cols % 64)) - 1)) | (Op::fill() & ~((uint64(1) << (cols % 64)) - 1));
+
+    // every line length of the row, each doubling a shorter one: a line of length 2k is two of length k
+    uint64 *slot = &ring[stage][(i % kh) * lens.size() * line_words];
+    shift_bits(row, words, &line_tmp[0], line_words, -pad, Op::fill());
+    int k = 1;
+    for(int l = 0; l < lens.size(); l++) {
+        for(; 2 * k <= lens[l]; k *= 2) {
+            shift_bits(&line_tmp[0], line_words, &tmp[0], line_words, k, Op::fill());
+            for(int w = 0; w < line_words; w++) line_tmp[w] = Op::apply(line_tmp[w], tmp[w]);
+        }
+        uint64 *line = slot + l * line_words;
+        if(lens[l] > k) {
+            shift_bits(&line_tmp[0], line_words, &tmp[0], line_words, lens[l] - k, Op::fill());
+            for(int w = 0; w < line_words; w++) line[w] = Op::apply(line_tmp[w], tmp[w]);
+        }
+        else std::copy(line_tmp.begin(), line_tmp.end(), line);
+    }
+
+    if(i - lag >= 0) emit<Op>(stage, i - lag);
+}
+
+template<class Op> inline void blobSegmenter::emit(int stage, int j) {
+    uint64 *o = &out[stage][0];
+    std::fill(o, o + words, Op::fill());
+    for(int l = 0; l < lines.size(); l++) {
+        int i = j + lines[l].dy;
+        if(i < 0 || i >= rows) continue;
+        const uint64 *line = &ring[stage][((i % kh) * lens.size() + lines[l].index) * line_words];
+        shift_bits(line, line_words, &tmp[0], words, lines[l].dx + pad, Op::fill());
+        for(int w = 0; w < words; w++) o[w] = Op::apply(o[w], tmp[w]);
+    }
+
+    if(stage < 3) {
+        push_stage(stage + 1, j, o);
+        return;
+    }
+
+    // unpack the row of the final mask
+    uchar *m = mask->ptr<uchar>(j);
+    int x = 0;
+#ifdef MORPHOLOGY_ENGINE_SSE2
+    const __m128i bits = _mm_setr_epi8(1, 2, 4, 8, 16, 32, 64, -128, 1, 2, 4, 8, 16, 32, 64, -128);
+    for(; x <= cols - 16; x += 16) {
+        unsigned v = unsigned(o[x / 64] >> (x % 64)) & 0xffff;
+        __m128i b = _mm_unpacklo_epi64(_mm_set1_epi8(char(v & 0xff)), _mm_set1_epi8(char(v >> 8)));
+        _mm_storeu_si128((__m128i *)(m + x), _mm_cmpeq_epi8(_mm_and_si128(b, bits), bits));
+    }
+#endif
+    for(; x < cols; x++) m[x] = (o[x / 64] >> (x % 64)) & 1 ? 255 : 0;
+}
+
+inline void blobSegmenter::threshold_row(const uchar *p, int cn, const uchar *low, const uchar *high, uint64 *row) const {
+    std::fill(row, row + words, uint64(0));
+    int x = 0;
+#ifdef MORPHOLOGY_ENGINE_SSE2
+    // bounds of the 16 bytes of each of the cn registers covering 16 pixels
+    __m128i lo[4], hi[4];
+    for(int r = 0; r < cn; r++) {
+        uchar l[16], h[16];
+        for(int b = 0; b < 16; b++) {
+            l[b] = low[(16 * r + b) % cn];
+            h[b] = high[(16 * r + b) % cn];
+        }
+        lo[r] = _mm_loadu_si128((const __m128i *)l);
+        hi[r] = _mm_loadu_si128((const __m128i *)h);
+    }
+    for(; x <= cols - 16; x += 16) {
+        // one bit per byte within its bounds, then a pixel is in range if all its cn bits are
+        uint64 in = 0;
+        for(int r = 0; r < cn; r++) {
+            __m128i v = _mm_loadu_si128((const __m128i *)(p + x * cn + 16 * r));
+            __m128i ok = _mm_and_si128(_mm_cmpeq_epi8(_mm_max_epu8(v, lo[r]), v), _mm_cmpeq_epi8(_mm_min_epu8(v, hi[r]), v));
+            in |= uint64(unsigned(_mm_movemask_epi8(ok))) << (16 * r);
+        }
+        uint64 all = in;
+        for(int c = 1; c < cn; c++) all &= in >> c;
+        unsigned pixels = 0;
+        if(cn == 1) pixels = unsigned(all);
+        else for(int q = 0; q < 16; q++) pixels |= unsigned((all >> (cn * q)) & 1) << q;
+        row[x / 64] |= uint64(pixels) << (x % 64);
+    }
+#endif
+    for(; x < cols; x++) {
+        bool in = true;
+        for(int c = 0; c < cn; c++) in = in && p[x * cn + c] >= low[c] && p[x * cn + c] <= high[c];
+        if(in) row[x / 64] |= uint64(1) << (x % 64);
+    }
+}
+
+inline void blobSegmenter::segment(const cv::Mat &src, cv::Scalar low, cv::Scalar high, cv::Mat &dst) {
+    CV_Assert(src.depth() == CV_8U && src.channels() <= 4);
+    int cn = src.channels();
+    uchar l[4], h[4];
+    for(int c = 0; c < cn; c++) {
+        l[c] = cv::saturate_cast<uchar>(low[c]);
+        h[c] = cv::saturate_cast<uchar>(high[c]);
+    }
+
+    rows = src.rows;
+    cols = src.cols;
+    words = (cols + 63) / 64;
+    line_words = (cols + pad + 63) / 64;
+    dst.create(src.size(), CV_8UC1);
+    mask = &dst;
+    for(int s = 0; s < 4; s++) {
+        ring[s].resize(kh * lens.size() * line_words);
+        out[s].resize(words);
+    }
+    tmp.resize(line_words);
+    line_tmp.resize(line_words);
+    std::vector<uint64> row(words);
+
+    for(int i = 0; i < rows; i++) {
+        threshold_row(src.ptr<uchar>(i), cn, l, h, &row[0]);
+        push_stage(0, i, &row[0]);
+    }
+    // the last rows of every stage have nothing more coming below them
+    for(int s = 0; s < 4; s++)
+        for(int j = std::max(0, rows - lag); j < rows; j++) emit_stage(s, j);
+}
+
+#endif
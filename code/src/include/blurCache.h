@@ -0,0 +1,147 @@
+// Cache of Gaussian blurs of one image
+// An interactive slider asks for the same few blurs over and over, each from scratch. blurCache keeps the last blurs
+// it computed, keyed by kernel size and sigma, and computes new ones from what it already has:
+// - Gaussians form a semigroup (blurring with sigma a and then b is blurring with sqrt(a^2 + b^2)), so a blur is
+//   computed from the cached one of the largest smaller sigma with the much smaller kernel of the difference
+// - large blurs are computed on a pyrDown() level of the image and brought back up with pyrUp(), the blur of both
+//   being subtracted the same way, which costs a fraction of a full resolution blur with a large kernel. pyrUp()
+//   samples on the grid of pyrDown(), so nothing is shifted, and the pyramid is built on the image padded like
+//   GaussianBlur() pads it, so the borders match too
+// Results differ from GaussianBlur() by the truncation of the kernels and rounding, a gray level or two at most
+
+#ifndef BLUR_CACHE_H
+#define BLUR_CACHE_H
+
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <map>
+#include <utility>
+#include <vector>
+
+class blurCache {
+    private:
+        struct entry {
+            cv::Mat blurred;
+            double sigma;
+            bool full; // computed at full resolution, so exact enough to build larger blurs on
+            int last_use;
+        };
+        cv::Mat image;
+        int margin; // pixels of BORDER_REFLECT_101 padding around the image in 'levels', a multiple of 2^(deepest level)
+        std::vector<cv::Mat> levels; // pyrDown() levels of the padded image, levels[0] being the padded image
+        std::map<std::pair<int, double>, entry> cache;
+        int uses;
+
+        const cv::Mat &level(int, int); // pyramid level of the image padded by at least some pixels, computed when first needed
+        const cv::Mat &store(int, double, const cv::Mat &, bool); // evicts the least recently used blur if full, returns the stored blur
+    public:
+        int capacity; // blurs kept
+        int big_kernel; // kernel size from which the pyramid is used
+        int max_level; // deepest pyramid level used
+
+        blurCache() {uses = 0; margin = 0; capacity = 8; big_kernel = 15; max_level = 3;}
+
+        void set_image(const cv::Mat &); // forgets the blurs of the previous image
+        // Image blurred like GaussianBlur() with a square kernel, sigma <= 0 meaning the sigma of the kernel size.
+        // The result is the cached blur itself (the image for a kernel size of 1), valid till the next call: it is
+        // read only, clone() it to draw on it or keep it
+        const cv::Mat &blur(int k_size, double sigma = 0);
+};
+
+// Odd kernel size covering 3 sigma on either side
+inline int gaussian_size(double sigma) {
+    return 2 * cvCeil(3 * sigma) + 1;
+}
+
+inline void blurCache::set_image(const cv::Mat &img) {
+    image = img;
+    margin = 0;
+    levels.clear();
+    cache.clear();
+    uses = 0;
+}
+
+inline const cv::Mat &blurCache::level(int l, int pad) {
+    // level pixel j is padded image pixel 2^l j, and image pixel 2^l j - margin
+    if(levels.empty() || pad > margin || margin % (1 << l)) {
+        int step = 1 << std::max(l, max_level);
+        margin = (pad + step - 1) / step * step;
+        cv::Mat padded;
+        cv::copyMakeBorder(image, padded, margin, margin, margin, margin, cv::BORDER_REFLECT_101);
+        levels.assign(1, padded);
+    }
+    while(levels.size() <= l) {
+        cv::Mat down;
+        cv::pyrDown(levels.back(), down);
+        levels.push_back(down);
+    }
+    return levels[l];
+}
+
+inline const cv::Mat &blurCache::store(int k_size, double sigma, const cv::Mat &blurred, bool full) {
+    if(cache.size() >= capacity && !cache.empty()) {
+        std::map<std::pair<int, double>, entry>::iterator oldest = cache.begin();
+        for(std::map<std::pair<int, double>, entry>::iterator it = cache.begin(); it != cache.end(); ++it)
+            if(it->second.last_use < oldest->second.last_use) oldest = it;
+        cache.erase(oldest);
+    }
+    entry &e = cache[std::make_pair(k_size, sigma)];
+    e.blurred = blurred;
+    e.sigma = sigma;
+    e.full = full;
+    e.last_use = uses++;
+    return e.blurred;
+}
+
+inline const cv::Mat &blurCache::blur(int k_size, double sigma) {
+    CV_Assert(!image.empty() && k_size > 0 && k_size % 2 == 1);
+    if(k_size == 1) return image;
+    if(sigma <= 0) sigma = 0.3 * ((k_size - 1) * 0.5 - 1) + 0.8; // as GaussianBlur() chooses it
+
+    std::map<std::pair<int, double>, entry>::iterator hit = cache.find(std::make_pair(k_size, sigma));
+    if(hit != cache.end()) {
+        hit->second.last_use = uses++;
+        return hit->second.blurred;
+    }
+
+    cv::Mat blurred;
+    if(k_size >= big_kernel) {
+        // deepest level on which at least a sigma of 1 level pixel is left to blur, after the blur of pyrDown() and
+        // that of pyrUp() (variance 1 at each level for both, (4^l - 1) / 3 full resolution pixels in all for each)
+        int l = 0;
+        double rest = 0;
+        for(int i = 1; i <= max_level && (image.cols >> i) > 0 && (image.rows >> i) > 0; i++) {
+            double scale = 1 << i, var = sigma * sigma - 2 * (scale * scale - 1) / 3;
+            if(var < scale * scale) break;
+            l = i;
+            rest = std::sqrt(var) / scale;
+        }
+        if(l > 0) {
+            // the padding covers what an image pixel depends on: s / 2 level pixels for the blur, and for each
+            // pyrDown() and pyrUp() 2 pixels of the finer of the two levels
+            int s = std::min(gaussian_size(rest), k_size);
+            cv::Mat cur;
+            cv::GaussianBlur(level(l, (1 << l) * (s / 2 + 4) - 4), cur, cv::Size(s, s), rest);
+            for(int i = l; i > 0; i--) {
+                cv::Mat up;
+                cv::pyrUp(cur, up, levels[i - 1].size());
+                cur = up;
+            }
+            return store(k_size, sigma, cur(cv::Rect(margin, margin, image.cols, image.rows)), false);
+        }
+    }
+
+    // largest smaller blur computed at full resolution, if the difference needs a smaller kernel
+    const entry *base = 0;
+    for(std::map<std::pair<int, double>, entry>::const_iterator it = cache.begin(); it != cache.end(); ++it)
+        if(it->second.full && it->second.sigma < sigma && (!base || it->second.sigma > base->sigma)) base = &it->second;
+    double delta = base ? std::sqrt(sigma * sigma - base->sigma * base->sigma) : 0;
+    if(base && gaussian_size(delta) < k_size) {
+        int s = gaussian_size(delta);
+        cv::GaussianBlur(base->blurred, blurred, cv::Size(s, s), delta);
+    }
+    else cv::GaussianBlur(image, blurred, cv::Size(k_size, k_size), sigma);
+    return store(k_size, sigma, blurred, true);
+}
+
+#endif
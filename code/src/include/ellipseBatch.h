@@ -0,0 +1,204 @@
+// Batch ellipse finding over a directory of images or the frames of a video
+// Images are read on the calling thread and handed through a bounded queue to a pool of workers, each finding the
+// ellipse of one image at a time on a single thread. Results are written in the order the images were read, to a
+// CSV file or a JSON file if the name ends in .json. The finder class is that of the program (code6-4, code6-5)
+// and the parameters are RANSACparams of ellipseRANSAC.h: the finder is constructed as
+// Finder(img, canny_l, canny_h, params, false) and must have find_ellipse(), get_ellipse() and get_inliers()
+
+#ifndef ELLIPSE_BATCH_H
+#define ELLIPSE_BATCH_H
+
+#include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <deque>
+#include <fstream>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <vector>
+#include "ellipseKernels.h"
+
+// An image of a batch
+struct batchImage {
+    int index; // position in the batch
+    std::string name; // file name, or frame number in a video
+    cv::Mat img;
+};
+
+// Queue of the images of a batch between the thread reading them and the workers. At most 'window' images are read but
+// not yet written out, so memory stays bounded however long the batch is and however long one image takes.
+// Results are written in the order the images were read
+class batchQueue {
+    private:
+        std::deque<batchImage> images; // images waiting for a worker
+        std::map<int, std::string> done; // results waiting for those of earlier images
+        int window, read, written, found;
+        bool finished; // set by the reader when there are no more images
+        bool json; // write JSON instead of CSV
+        std::ostream *out;
+        boost::mutex mtx;
+        boost::condition_variable not_empty, not_full;
+    public:
+        batchQueue(std::ostream *_out, bool _json, int _window);
+
+        void push(const std::string &, const cv::Mat &); // reader: wait for room in the window, then add an image
+        void finish(); // reader: no more images
+        bool pop(batchImage &); // worker: wait for an image, false when the batch is over
+        void result(const batchImage &, bool, const float *, int); // worker: write out the result for an image
+        void close(); // write the end of the output once the workers are done
+        int images_read() {return read;}
+        int ellipses_found() {return found;}
+};
+
+inline batchQueue::batchQueue(std::ostream *_out, bool _json, int _window) {
+    out = _out;
+    json = _json;
+    window = std::max(1, _window);
+    read = written = found = 0;
+    finished = false;
+    if(json) *out << "[";
+    else *out << "image,found,inliers,a,b,c,d,e,f" << std::endl;
+}
+
+inline void batchQueue::push(const std::string &name, const cv::Mat &img) {
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        while(read - written >= window) not_full.wait(lock);
+        batchImage b;
+        b.index = read++;
+        b.name = name;
+        b.img = img;
+        images.push_back(b);
+    }
+    not_empty.notify_one();
+}
+
+inline void batchQueue::finish() {
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        finished = true;
+    }
+    not_empty.notify_all();
+}
+
+inline bool batchQueue::pop(batchImage &b) {
+    boost::unique_lock<boost::mutex> lock(mtx);
+    while(images.empty() && !finished) not_empty.wait(lock);
+    if(images.empty()) return false;
+    b = images.front();
+    images.pop_front();
+    return true;
+}
+
+inline void batchQueue::result(const batchImage &b, bool ok, const float *q, int inliers) {
+    // format outside the lock
+    std::ostringstream line;
+    if(json) {
+        std::string name;
+        for(int i = 0; i < b.name.size(); i++) {
+            if(b.name[i] == '"' || b.name[i] == '\\') name += '\\';
+            name += b.name[i];
+        }
+        line << "\n  {\"image\": \"" << name << "\", \"found\": " << (ok ? "true" : "false") << ", \"inliers\": " << inliers << ", \"conic\": [";
+        for(int i = 0; i < 6; i++) line << (i ? ", " : "") << (ok ? q[i] : 0.f);
+        line << "]}";
+    }
+    else {
+        line << b.name << "," << ok << "," << inliers;
+        for(int i = 0; i < 6; i++) line << "," << (ok ? q[i] : 0.f);
+        line << "\n";
+    }
+
+    {
+        boost::unique_lock<boost::mutex> lock(mtx);
+        done[b.index] = line.str();
+        found += ok;
+        // write out the results that are next in order
+        while(!done.empty() && done.begin()->first == written) {
+            if(json && written > 0) *out << ",";
+            *out << done.begin()->second;
+            done.erase(done.begin());
+            written++;
+        }
+    }
+    not_full.notify_one();
+}
+
+inline void batchQueue::close() {
+    if(json) *out << "\n]" << std::endl;
+    out->flush();
+}
+
+// Worker of a batch: finds the ellipse in images from the queue till the batch is over
+template<class Finder, class Params> void batch_worker(batchQueue *queue, Params rp, int canny_l, int canny_h) {
+    batchImage b;
+    while(queue->pop(b)) {
+        Finder ef(b.img, canny_l, canny_h, rp, false);
+        bool ok = ef.find_ellipse();
+        float q[6];
+        conic_coeffs(ef.get_ellipse(), q);
+        queue->result(b, ok, q, ef.get_inliers());
+    }
+}
+
+// Find the ellipse in every image of a directory or frame of a video on a pool of worker threads, writing the conics
+// and inlier counts to a CSV file, or a JSON file if the name ends in .json
+template<class Finder, class Params> int run_batch(std::string source, std::string output, Params rp, int canny_l, int canny_h) {
+    std::vector<std::string> files;
+    cv::VideoCapture cap;
+    if(boost::filesystem::is_directory(source)) {
+        for(boost::filesystem::directory_iterator i(source), end_iter; i != end_iter; i++)
+            if(boost::filesystem::is_regular_file(i->status())) files.push_back(i->path().string());
+        std::sort(files.begin(), files.end());
+    }
+    else if(!cap.open(source)) {
+        std::cout << "Could not open " << source << std::endl;
+        return -1;
+    }
+    std::ofstream out(output.c_str());
+    if(!out) {
+        std::cout << "Could not write " << output << std::endl;
+        return -1;
+    }
+    bool json = output.size() >= 5 && output.substr(output.size() - 5) == ".json";
+
+    // images are processed in parallel, each one on a single thread
+    cv::setNumThreads(0);
+    int workers = std::max(1, int(boost::thread::hardware_concurrency()));
+    int window = 4 * workers; // images read ahead of the results written, change if you want
+    batchQueue queue(&out, json, window);
+    boost::thread_group pool;
+    for(int i = 0; i < workers; i++) pool.add_thread(new boost::thread(batch_worker<Finder, Params>, &queue, rp, canny_l, canny_h));
+
+    double t0 = cv::getTickCount();
+    if(!cap.isOpened()) {
+        for(int i = 0; i < files.size(); i++) {
+            cv::Mat img = cv::imread(files[i]);
+            if(img.empty()) continue; // not an image
+            queue.push(boost::filesystem::path(files[i]).filename().string(), img);
+        }
+    }
+    else {
+        cv::Mat frame;
+        for(int f = 0; cap.read(frame); f++) {
+            std::ostringstream name;
+            name << f;
+            // the capture reuses its buffer
+            queue.push(name.str(), frame.clone());
+        }
+    }
+    queue.finish();
+    pool.join_all();
+    queue.close();
+    double t = (cv::getTickCount() - t0) / cv::getTickFrequency();
+
+    std::cout << queue.images_read() << " images in " << t << " s on " << workers << " threads, "
+              << queue.images_read() / t << " images per second" << std::endl;
+    std::cout << "Ellipse found in " << queue.ellipses_found() << " images, results written to " << output << std::endl;
+    return 0;
+}
+
+#endif
@@ -0,0 +1,197 @@
+// Kernels used by the RANSAC ellipse finders of chapter 6
+// Contour points are kept as a structure of arrays (all x co-ordinates, then all y co-ordinates) so that the loops
+// scoring a conic against them have no gathers and no branches, and are vectorized by the compiler at -O2 -ftree-vectorize or -O3
+// Ellipses are fitted with fixed size matrices only, so fitting never allocates memory
+// RANSAC samples are drawn as indices into one buffer holding the points of all contours, so drawing and fitting a
+// hypothesis does not allocate memory either
+
+#ifndef ELLIPSE_KERNELS_H
+#define ELLIPSE_KERNELS_H
+
+#include <Eigen/Dense>
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Points of a contour as separate x and y arrays
+struct pointsSoA {
+    std::vector<float> x, y;
+
+    pointsSoA() {}
+    pointsSoA(const std::vector<cv::Point> &c) { assign(c); }
+    void assign(const std::vector<cv::Point> &c) {
+        x.resize(c.size());
+        y.resize(c.size());
+        for(int i = 0; i < int(c.size()); i++) {
+            x[i] = c[i].x;
+            y[i] = c[i].y;
+        }
+    }
+    int size() const { return x.size(); }
+};
+
+// Points of all the contours of an image in one structure of arrays, contour i being points start[i] to start[i + 1] - 1
+struct contoursSoA {
+    std::vector<float> x, y;
+    std::vector<int> start;
+
+    void assign(const std::vector<std::vector<cv::Point> > &c) {
+        start.resize(c.size() + 1);
+        start[0] = 0;
+        for(int i = 0; i < int(c.size()); i++) start[i + 1] = start[i] + c[i].size();
+        x.resize(start.back());
+        y.resize(start.back());
+        for(int i = 0; i < int(c.size()); i++) {
+            for(int j = 0; j < int(c[i].size()); j++) {
+                x[start[i] + j] = c[i][j].x;
+                y[start[i] + j] = c[i][j].y;
+            }
+        }
+    }
+    int contours() const { return int(start.size()) - 1; }
+    int size(int i) const { return start[i + 1] - start[i]; }
+    // x and y co-ordinates of the points of contour i (which must not be empty)
+    const float *xs(int i) const { return &x[start[i]]; }
+    const float *ys(int i) const { return &y[start[i]]; }
+};
+
+// Append the contours of 'c' longer than 50 pixels to 'contours', removing small spurious ones. This is the filter
+// the ellipse finders have always used: the test for a closed contour was written as
+// sqrt((p1.x - p2.x)^2 + (p1.y - p2.y)^2) <= 0.5, where ^ is XOR and binds looser than +. It is kept as it parses,
+// with the parentheses spelled out, so that the contours found do not change
+inline void keep_long_contours(const std::vector<std::vector<cv::Point> > &c, std::vector<std::vector<cv::Point> > &contours) {
+    for(int i = 0; i < c.size(); i++) {
+        bool is_closed = false;
+
+        const std::vector<cv::Point> &_c = c[i];
+
+        cv::Point p1 = _c.front(), p2 = _c.back();
+        float d = std::sqrt(float((p1.x - p2.x) ^ (2 + (p1.y - p2.y)) ^ 2));
+        if(d <= 0.5) is_closed = true;
+
+        d = cv::arcLength(_c, is_closed);
+
+        if(d > 50) contours.push_back(_c);
+    }
+}
+
+// Draw n distinct indices from 0 to size - 1 into 'idx' (at most size of them). Samples are small compared to
+// contours, so drawing again on a repeat is cheaper than shuffling
+inline int draw_sample(int size, int n, cv::RNG &rng, int *idx) {
+    n = std::min(n, size);
+    for(int k = 0; k < n; ) {
+        int i = rng.uniform(0, size);
+        bool repeat = false;
+        for(int j = 0; j < k; j++) repeat |= idx[j] == i;
+        if(!repeat) idx[k++] = i;
+    }
+    return n;
+}
+
+// Coefficients (a, b, c, d, e, f) of the conic a*x^2 + b*x*y + c*y^2 + d*x + e*y + f = 0 held in a 6x1 CV_32F Mat
+// (which may be a column of a larger matrix, so it is read element by element)
+inline void conic_coeffs(const cv::Mat &Q, float q[6]) {
+    for(int i = 0; i < 6; i++) q[i] = Q.at<float>(i, 0);
+}
+
+// Sampson distance of n points from a conic: the value of the conic polynomial divided by the norm of its gradient.
+// It is a first order approximation of the orthogonal distance, exact on the conic and accurate within a few pixels
+// of it, which is all an inlier test needs. The sign tells the side of the conic the point is on
+inline void conic_distance(const float q[6], const float *x, const float *y, int n, float *dist) {
+    const float a = q[0], b = q[1], c = q[2], d = q[3], e = q[4], f = q[5];
+    for(int i = 0; i < n; i++) {
+        float px = x[i], py = y[i];
+        float F = (a * px + b * py + d) * px + (c * py + e) * py + f;
+        float gx = 2 * a * px + b * py + d, gy = b * px + 2 * c * py + e;
+        dist[i] = F / std::sqrt(gx * gx + gy * gy + 1e-12f);
+    }
+}
+
+// Number of points within 'thresh' of a conic, marking them in 'inlier' (1 or 0). Comparing squares avoids the
+// square root and the division of conic_distance()
+inline int count_inliers(const float q[6], const float *x, const float *y, int n, float thresh, unsigned char *inlier) {
+    const float a = q[0], b = q[1], c = q[2], d = q[3], e = q[4], f = q[5], t2 = thresh * thresh;
+    int count = 0;
+    for(int i = 0; i < n; i++) {
+        float px = x[i], py = y[i];
+        float F = (a * px + b * py + d) * px + (c * py + e) * py + f;
+        float gx = 2 * a * px + b * py + d, gy = b * px + 2 * c * py + e;
+        unsigned char in = F * F < t2 * (gx * gx + gy * gy);
+        inlier[i] = in;
+        count += in;
+    }
+    return count;
+}
+
+// Direct least squares ellipse fit (Fitzgibbon, Pilu and Fisher) in the numerically stable form of Halir and Flusser.
+// The 6x6 scatter matrix of the rows (x^2, xy, y^2, x, y, 1) is accumulated point by point, then the constrained
+// eigenproblem is reduced to a 3x3 one whose eigenvector with 4ac - b^2 > 0 is the ellipse
+class conicScatter {
+    private:
+        double S[6][6]; // upper triangle of the scatter matrix
+    public:
+        conicScatter() { clear(); }
+        void clear() {
+            for(int i = 0; i < 6; i++)
+                for(int j = 0; j < 6; j++) S[i][j] = 0;
+        }
+        void add(double x, double y) {
+            double d[6] = {x * x, x * y, y * y, x, y, 1};
+            for(int i = 0; i < 6; i++)
+                for(int j = i; j < 6; j++) S[i][j] += d[i] * d[j];
+        }
+        // Coefficients (a, b, c, d, e, f) of the fitted ellipse, false if the points do not determine one
+        bool solve(float q[6]) const {
+            Eigen::Matrix<double, 6, 6> M6;
+            for(int i = 0; i < 6; i++)
+                for(int j = i; j < 6; j++) M6(i, j) = M6(j, i) = S[i][j];
+            Eigen::Matrix3d S1 = M6.block<3, 3>(0, 0), S2 = M6.block<3, 3>(0, 3), S3 = M6.block<3, 3>(3, 3), S3inv;
+            bool invertible;
+            S3.computeInverseWithCheck(S3inv, invertible);
+            if(!invertible) return false;
+            // the linear part as a function of the quadratic part, and the reduced scatter matrix
+            Eigen::Matrix3d T = -S3inv * S2.transpose(), M = S1 + S2 * T, R;
+            // premultiply by the inverse of the constraint matrix [0 0 2; 0 -1 0; 2 0 0]
+            R.row(0) = M.row(2) / 2;
+            R.row(1) = -M.row(1);
+            R.row(2) = M.row(0) / 2;
+
+            Eigen::EigenSolver<Eigen::Matrix3d> es(R);
+            if(es.info() != Eigen::Success) return false;
+            for(int k = 0; k < 3; k++) {
+                Eigen::Vector3d a1 = es.eigenvectors().col(k).real();
+                if(4 * a1(0) * a1(2) - a1(1) * a1(1) <= 0) continue;
+                Eigen::Vector3d a2 = T * a1;
+                for(int i = 0; i < 3; i++) {
+                    q[i] = a1(i);
+                    q[i + 3] = a2(i);
+                }
+                return true;
+            }
+            return false;
+        }
+};
+
+// Fit an ellipse to points, to the points of a structure of arrays, or to those of them marked in 'mask'
+inline bool fit_conic(const cv::Point *p, int n, float q[6]) {
+    conicScatter S;
+    for(int i = 0; i < n; i++) S.add(p[i].x, p[i].y);
+    return S.solve(q);
+}
+
+inline bool fit_conic(const float *x, const float *y, const unsigned char *mask, int n, float q[6]) {
+    conicScatter S;
+    for(int i = 0; i < n; i++)
+        if(!mask || mask[i]) S.add(x[i], y[i]);
+    return S.solve(q);
+}
+
+// Fit an ellipse to the n points of a structure of arrays whose indices are in 'idx'
+inline bool fit_conic_sample(const float *x, const float *y, const int *idx, int n, float q[6]) {
+    conicScatter S;
+    for(int i = 0; i < n; i++) S.add(x[idx[i]], y[idx[i]]);
+    return S.solve(q);
+}
+
+#endif
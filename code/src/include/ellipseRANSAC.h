@@ -0,0 +1,317 @@
+// Parallel RANSAC search for the best ellipse in a set of contours, shared by the ellipse finders of chapter 6
+// The hypotheses are split into tasks (one per contour, and runs of hypotheses for long contours), each drawing from
+// its own random stream so that the ellipse found for a seed does not depend on the number of threads. Tasks run on
+// the OpenCV thread pool, longest contour first. With adaptive termination every task stops once it has drawn enough
+// hypotheses for the inlier ratio of its best ellipse, pre-tests hypotheses on a few random points before scoring them
+// on the whole contour, and gives up on its contour once another task has found a valid ellipse with more inliers than
+// the contour has points
+
+#ifndef ELLIPSE_RANSAC_H
+#define ELLIPSE_RANSAC_H
+
+#include <opencv2/opencv.hpp>
+#include <boost/atomic.hpp>
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <utility>
+#include <vector>
+#include "ellipseKernels.h"
+
+// Class to hold RANSAC parameters
+class RANSACparams {
+    private:
+        //number of iterations
+        int iter;
+        //minimum number of inliers to further process a model
+        int min_inliers;
+        //distance threshold to be conted as inlier
+        float dist_thresh;
+        //number of points to select randomly at each iteration
+        int N;
+        //seed of the random streams, the same seed gives the same ellipse whatever the number of threads
+        uint64 seed;
+        //adaptive termination: stop drawing hypotheses once one with all inliers has been drawn with this confidence
+        bool adaptive;
+        double confidence;
+        //number of random points that must all be inliers of a hypothesis before it is scored on the whole contour
+        int pretest;
+    public:
+        RANSACparams(int _iter, int _min_inliers, float _dist_thresh, int _N, uint64 _seed = 12345) { //constructor
+            iter = _iter;
+            min_inliers = _min_inliers;
+            dist_thresh = _dist_thresh;
+            N = _N;
+            seed = _seed;
+            adaptive = false;
+            confidence = 0.99;
+            pretest = 0;
+        }
+        void set_adaptive(bool _adaptive, double _confidence = 0.99, int _pretest = 1) { //turn adaptive termination on or off
+            adaptive = _adaptive;
+            confidence = _confidence;
+            pretest = std::max(0, std::min(_pretest, 8));
+        }
+
+        int get_iter() {return iter;}
+        int get_min_inliers() {return min_inliers;}
+        float get_dist_thresh() {return dist_thresh;}
+        int get_N() {return N;}
+        uint64 get_seed() {return seed;}
+        bool get_adaptive() {return adaptive;}
+        double get_confidence() {return confidence;}
+        int get_pretest() {return pretest;}
+};
+
+// One unit of RANSAC work: a run of hypotheses on one contour, drawn from its own random stream
+struct RANSACtask {
+    int contour; // index of the contour
+    int iterations; // number of hypotheses to try
+    uint64 stream; // seed of the random stream of this task
+    int mask; // start of the inlier mask of the task in the shared buffer
+    int score; // result: inliers of the best hypothesis...
+    float q[6]; // ...and the ellipse refitted to them
+    int run, rejected; // hypotheses drawn, and rejected by the pre-test
+    bool pruned; // stopped because the contour could not beat the best ellipse found
+};
+
+// Work done by the last RANSAC search
+struct RANSACstats {
+    int iterations; // hypotheses drawn...
+    int max_iterations; // ...out of this many
+    int rejected; // hypotheses rejected by the pre-test without being scored
+    int pruned; // tasks stopped because their contour could not beat the best ellipse
+};
+
+// Whether a conic is an ellipse that is not too elongated and whose major axis is at most max_axis long
+inline bool is_good_conic(const float q[6], int max_axis) {
+    float a = q[0],
+          b = q[1]/2,
+          c = q[2],
+          d = q[3]/2,
+          f = q[4]/2,
+          g = q[5];
+
+    if(b*b - a*c == 0) return false;
+
+    float thresh = 0.09,
+        num = 2 * (a*f*f + c*d*d + g*b*b - 2*b*d*f - a*c*g),
+        den1 = (b*b - a*c) * (std::sqrt((a-c)*(a-c) + 4*b*b) - (a + c)),
+        den2 = (b*b - a*c) * (-std::sqrt((a-c)*(a-c) + 4*b*b) - (a + c)),
+        a_len = std::sqrt(num / den1),
+        b_len = std::sqrt(num / den2),
+        major_axis = std::max(a_len, b_len),
+        minor_axis = std::min(a_len, b_len);
+
+    if(minor_axis < thresh*major_axis || num/den1 < 0.f || num/den2 < 0.f || major_axis > max_axis) return false;
+    else return true;
+}
+
+class ellipseRANSAC {
+    friend class RANSACbody;
+    private:
+        // RANSAC parameters
+        int iter, min_inliers, N, pretest;
+        float dist_thresh;
+        uint64 seed;
+        bool adaptive;
+        double confidence;
+
+        // search being run
+        int max_axis; // longest major axis of a valid ellipse
+        cv::Mat prior; // conic tested as the first hypothesis of every task, empty if none
+        boost::atomic<int> best_score; // inliers of the best valid ellipse found so far by any task
+        RANSACstats stats;
+        int inliers;
+        contoursSoA points; // points of all contours, kept between searches so that their memory is reused
+        std::vector<unsigned char> masks; // inlier masks of all tasks, likewise
+
+        void run_task(RANSACtask &, const float *, const float *, int, unsigned char *); // run the hypotheses of one task on the points of a contour
+    public:
+        ellipseRANSAC(RANSACparams rp);
+
+        // Find the ellipse with the most inliers in the contours, with a major axis at most max_axis long, trying
+        // 'prior' (if not empty) as the first hypothesis of every task. Returns the index of its contour, -1 if there
+        // is none, and its conic with f >= 0 in q
+        int search(const std::vector<std::vector<cv::Point> > &contours, int max_axis, float q[6], const cv::Mat &prior = cv::Mat());
+        int get_inliers() {return inliers;} // inliers of the last ellipse found, 0 if none was found
+        RANSACstats get_stats() {return stats;} // work done by the last search
+        void print_stats(); // print the work done by the last search
+};
+
+// Runs RANSAC tasks on the OpenCV thread pool
+class RANSACbody : public cv::ParallelLoopBody {
+    private:
+        ellipseRANSAC *er;
+        std::vector<RANSACtask> *tasks;
+        const std::vector<int> *order; // order in which the tasks are run
+    public:
+        RANSACbody(ellipseRANSAC *_er, std::vector<RANSACtask> *_tasks, const std::vector<int> *_order) {
+            er = _er;
+            tasks = _tasks;
+            order = _order;
+        }
+        void operator()(const cv::Range &r) const {
+            for(int i = r.start; i < r.end; i++) {
+                RANSACtask &t = (*tasks)[(*order)[i]];
+                const contoursSoA &p = er->points;
+                er->run_task(t, p.xs(t.contour), p.ys(t.contour), p.size(t.contour), &er->masks[t.mask]);
+            }
+        }
+};
+
+inline ellipseRANSAC::ellipseRANSAC(RANSACparams rp) : best_score(0) {
+    iter = rp.get_iter();
+    min_inliers = rp.get_min_inliers();
+    N = rp.get_N();
+    seed = rp.get_seed();
+    dist_thresh = rp.get_dist_thresh();
+    adaptive = rp.get_adaptive();
+    confidence = rp.get_confidence();
+    pretest = rp.get_pretest();
+    stats.iterations = stats.max_iterations = stats.rejected = stats.pruned = 0;
+    max_axis = 0;
+    inliers = 0;
+}
+
+inline void ellipseRANSAC::run_task(RANSACtask &t, const float *x, const float *y, int n, unsigned char *inlier) {
+    cv::RNG rng(t.stream);
+    std::vector<int> sample(N);
+    t.score = t.run = t.rejected = 0;
+    t.pruned = false;
+    // hypotheses to draw, lowered by adaptive termination as better ellipses are found
+    int needed = t.iterations;
+    // while tracking, the ellipse of the previous frame is hypothesis -1
+    for(int j = prior.empty() ? 0 : -1; j < needed; j++) {
+        // no hypothesis can have more inliers than the contour has points, so stop once another task has found
+        // a valid ellipse with more inliers. Only contours that cannot win are cut, so the result does not change
+        if(adaptive && n < best_score.load(boost::memory_order_relaxed)) {
+            t.pruned = true;
+            break;
+        }
+        float q[6];
+        if(j < 0) conic_coeffs(prior, q);
+        else {
+            t.run++;
+            // ...choose points at random...
+            int n_sample = draw_sample(n, N, rng, &sample[0]);
+            // ...fit ellipse to those points...
+            if(!fit_conic_sample(x, y, &sample[0], n_sample, q)) continue;
+            // ...reject it cheaply unless a few other random points of the contour are all inliers (the T(d,d) test)...
+            if(adaptive && pretest > 0) {
+                float px[8], py[8];
+                unsigned char in[8];
+                for(int k = 0; k < pretest; k++) {
+                    int idx = rng.uniform(0, n);
+                    px[k] = x[idx];
+                    py[k] = y[idx];
+                }
+                if(count_inliers(q, px, py, pretest, dist_thresh, in) < pretest) {
+                    t.rejected++;
+                    continue;
+                }
+            }
+        }
+        // ...check for inliers (the chosen points are on the fitted conic, so they count too)...
+        int score = count_inliers(q, x, y, n, dist_thresh, inlier);
+        // ...and find the random set with the most number of inliers, refitting the ellipse to all of them
+        if(score > min_inliers && score > t.score && fit_conic(x, y, inlier, n, q)) {
+            if(!is_good_conic(q, max_axis)) continue;
+            std::copy(q, q + 6, t.q);
+            t.score = score;
+            if(!adaptive) continue;
+
+            // A sample of N points (and the pre-test points) is all inliers with probability w^(N + pretest) for an
+            // inlier ratio w, so log(1 - confidence) / log(1 - w^(N + pretest)) samples draw one with the given confidence.
+            // This task draws its share of them
+            double w = double(score) / n, p_good = std::pow(w, N + pretest);
+            int k = p_good >= 1 ? 1 : int(std::ceil(std::log(1 - confidence) / std::log(1 - p_good)));
+            needed = std::min(needed, std::max(j + 1, int(std::ceil(double(k) * t.iterations / iter))));
+
+            // raise the bound the other tasks prune against, unless another task has raised it further meanwhile
+            int best = best_score.load(boost::memory_order_relaxed);
+            while(score > best && !best_score.compare_exchange_weak(best, score, boost::memory_order_relaxed)) {}
+        }
+    }
+}
+
+inline int ellipseRANSAC::search(const std::vector<std::vector<cv::Point> > &contours, int _max_axis, float q[6], const cv::Mat &_prior) {
+    max_axis = _max_axis;
+    prior = _prior;
+    int best_overall_inlier_score = 0;
+    int idx_best = -1;
+
+    // Split the work into tasks: one per contour, and the hypotheses of large contours into runs of 'chunk'
+    // so that a few long contours do not keep one thread busy while the others wait
+    int chunk = 100, large_contour = 500;
+    // x and y co-ordinates of all contours in separate arrays, samples are drawn as indices into them and every
+    // hypothesis is scored against all points of its contour in one pass
+    points.assign(contours);
+    std::vector<RANSACtask> tasks;
+    int mask_size = 0;
+    for(int i = 0; i < contours.size(); i++) {
+        if(contours[i].size() < min_inliers) continue;
+        int n = contours[i].size() >= large_contour ? (iter + chunk - 1) / chunk : 1;
+        for(int k = 0; k < n; k++) {
+            RANSACtask t;
+            t.contour = i;
+            t.iterations = (k + 1) * iter / n - k * iter / n;
+            // every task gets its own stream derived from the seed and its position in the list, so the
+            // hypotheses do not depend on which thread runs the task
+            t.stream = (seed + 1) * 6364136223846793005ULL + (tasks.size() + 1) * 1442695040888963407ULL;
+            t.mask = mask_size;
+            mask_size += contours[i].size();
+            t.score = 0;
+            tasks.push_back(t);
+        }
+    }
+
+    // Start with the longest contours, which have the most inliers, so that the bound on the others is known early
+    std::vector<std::pair<int, int> > by_size;
+    for(int t = 0; t < tasks.size(); t++) by_size.push_back(std::make_pair(-int(contours[tasks[t].contour].size()), t));
+    std::sort(by_size.begin(), by_size.end());
+    std::vector<int> order;
+    for(int t = 0; t < by_size.size(); t++) order.push_back(by_size[t].second);
+
+    masks.resize(mask_size);
+    best_score.store(0, boost::memory_order_relaxed);
+    cv::parallel_for_(cv::Range(0, tasks.size()), RANSACbody(this, &tasks, &order));
+    prior = cv::Mat();
+
+    stats.iterations = stats.max_iterations = stats.rejected = stats.pruned = 0;
+    for(int t = 0; t < tasks.size(); t++) {
+        stats.iterations += tasks[t].run;
+        stats.max_iterations += tasks[t].iterations;
+        stats.rejected += tasks[t].rejected;
+        stats.pruned += tasks[t].pruned;
+    }
+
+    // Reduce in task order, keeping the first of equal scores, so that the result is the same for a given seed
+    for(int t = 0; t < tasks.size(); ) {
+        int i = tasks[t].contour, best_inlier_score = 0;
+        const float *best_q = 0;
+        for(; t < tasks.size() && tasks[t].contour == i; t++) {
+            if(tasks[t].score > best_inlier_score) {
+                best_inlier_score = tasks[t].score;
+                best_q = tasks[t].q;
+            }
+        }
+        // find cotour with ellipse that has the most number of inliers (tasks keep only valid ellipses)
+        if(best_inlier_score > best_overall_inlier_score) {
+            best_overall_inlier_score = best_inlier_score;
+            float sign = best_q[5] < 0 ? -1.f : 1.f;
+            for(int k = 0; k < 6; k++) q[k] = sign * best_q[k];
+            idx_best = i;
+        }
+    }
+
+    inliers = best_overall_inlier_score;
+    return idx_best;
+}
+
+inline void ellipseRANSAC::print_stats() {
+    std::cout << "RANSAC hypotheses: " << stats.iterations << " of " << stats.max_iterations << ", " << stats.rejected
+              << " rejected by the pre-test, " << stats.pruned << " tasks stopped early" << std::endl;
+}
+
+#endif
@@ -0,0 +1,95 @@
+// Fused Scharr gradient magnitude
+// Two Scharr() calls into float images, pow(), add, sqrt() and convertTo(CV_8U) make six passes over the image and
+// four float temporaries. scharr_magnitude() reads the 8 bit gray image once, computes both derivatives of every pixel
+// in registers and writes the saturated 8 bit magnitude directly, 8 pixels at a time with SSE2 where available.
+// Horizontal bands of rows are processed in parallel. Borders are reflected like Scharr() (BORDER_REFLECT_101), and
+// the result equals that of the float chain
+
+#ifndef GRADIENT_KERNELS_H
+#define GRADIENT_KERNELS_H
+
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define GRADIENT_KERNELS_SSE2 1
+#endif
+
+// Scharr magnitude of pixel x of row r1, r0 and r2 being the rows above and below it and xl and xr the columns left
+// and right of it
+inline uchar scharr_pixel(const uchar *r0, const uchar *r1, const uchar *r2, int xl, int x, int xr) {
+    int gx = 3 * (r0[xr] - r0[xl] + r2[xr] - r2[xl]) + 10 * (r1[xr] - r1[xl]);
+    int gy = 3 * (r2[xl] - r0[xl] + r2[xr] - r0[xr]) + 10 * (r2[x] - r0[x]);
+    return cv::saturate_cast<uchar>(std::sqrt(float(gx * gx + gy * gy)));
+}
+
+// Magnitude of the rows of a band
+class scharrBands : public cv::ParallelLoopBody {
+    private:
+        const cv::Mat *src;
+        cv::Mat *dst;
+    public:
+        scharrBands(const cv::Mat *_src, cv::Mat *_dst) {
+            src = _src;
+            dst = _dst;
+        }
+        void operator()(const cv::Range &range) const {
+            int rows = src->rows, cols = src->cols;
+            for(int y = range.start; y < range.end; y++) {
+                // reflected neighbours (a single row or column is its own neighbour)
+                int ya = y > 0 ? y - 1 : std::min(1, rows - 1), yb = y < rows - 1 ? y + 1 : std::max(rows - 2, 0);
+                const uchar *r0 = src->ptr<uchar>(ya), *r1 = src->ptr<uchar>(y), *r2 = src->ptr<uchar>(yb);
+                uchar *out = dst->ptr<uchar>(y);
+
+                out[0] = scharr_pixel(r0, r1, r2, std::min(1, cols - 1), 0, std::min(1, cols - 1));
+                int x = 1;
+#ifdef GRADIENT_KERNELS_SSE2
+                const __m128i zero = _mm_setzero_si128(), three = _mm_set1_epi16(3), ten = _mm_set1_epi16(10);
+                for(; x <= cols - 9; x += 8) {
+                    // 8 pixels of the three rows, shifted one column left and right, widened to 16 bits
+                    __m128i a0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r0 + x - 1)), zero);
+                    __m128i b0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r0 + x)), zero);
+                    __m128i c0 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r0 + x + 1)), zero);
+                    __m128i a1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r1 + x - 1)), zero);
+                    __m128i c1 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r1 + x + 1)), zero);
+                    __m128i a2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r2 + x - 1)), zero);
+                    __m128i b2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r2 + x)), zero);
+                    __m128i c2 = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(r2 + x + 1)), zero);
+
+                    // derivatives fit in 16 bits (at most 16 * 255 in magnitude)
+                    __m128i gx = _mm_add_epi16(_mm_mullo_epi16(three, _mm_add_epi16(_mm_sub_epi16(c0, a0), _mm_sub_epi16(c2, a2))),
+                                               _mm_mullo_epi16(ten, _mm_sub_epi16(c1, a1)));
+                    __m128i gy = _mm_add_epi16(_mm_mullo_epi16(three, _mm_add_epi16(_mm_sub_epi16(a2, a0), _mm_sub_epi16(c2, c0))),
+                                               _mm_mullo_epi16(ten, _mm_sub_epi16(b2, b0)));
+
+                    // gx * gx + gy * gy in 32 bits by multiplying the interleaved derivatives with themselves and adding pairs
+                    __m128i lo = _mm_unpacklo_epi16(gx, gy), hi = _mm_unpackhi_epi16(gx, gy);
+                    __m128 m_lo = _mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(lo, lo)));
+                    __m128 m_hi = _mm_sqrt_ps(_mm_cvtepi32_ps(_mm_madd_epi16(hi, hi)));
+
+                    // round like cvRound() and saturate to 8 bits
+                    __m128i m = _mm_packs_epi32(_mm_cvtps_epi32(m_lo), _mm_cvtps_epi32(m_hi));
+                    _mm_storel_epi64((__m128i *)(out + x), _mm_packus_epi16(m, zero));
+                }
+#endif
+                for(; x < cols - 1; x++) out[x] = scharr_pixel(r0, r1, r2, x - 1, x, x + 1);
+                if(cols > 1) out[cols - 1] = scharr_pixel(r0, r1, r2, cols - 2, cols - 1, cols - 2);
+            }
+        }
+};
+
+// Magnitude of the Scharr gradient of an 8 bit single channel image, saturated to 8 bits
+inline void scharr_magnitude(const cv::Mat &gray, cv::Mat &magnitude) {
+    CV_Assert(gray.type() == CV_8UC1);
+    if(magnitude.data == gray.data) { // rows are still read after being written, so not in place
+        cv::Mat m;
+        scharr_magnitude(gray, m);
+        magnitude = m;
+        return;
+    }
+    magnitude.create(gray.size(), CV_8UC1);
+    // a few bands per thread so that threads finishing early can take more
+    cv::parallel_for_(cv::Range(0, gray.rows), scharrBands(&gray, &magnitude), 4 * cv::getNumThreads());
+}
+
+#endif
@@ -0,0 +1,120 @@
+// Headless throughput mode shared by the programs that capture and display frames in a loop
+// Run any of them as
+//     ./program --headless <video file or image sequence like frames/%04d.jpg> [second source for stereo programs]
+// to process the source till it ends without opening any window, and print per-stage latency percentiles and fps
+// Without arguments the programs behave as before (camera input, windows, 'q' to quit)
+// Stage latencies go to the shared stageProfiler in both modes, a "frame" stage times every loop iteration
+// Programs including this header must be linked with -lboost_thread -lboost_system
+
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include <opencv2/opencv.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <iostream>
+#include <string>
+#include <vector>
+#include "profiler.h"
+
+class headlessRunner {
+    private:
+        bool headless;
+        std::vector<std::string> sources; // input files, one per stream
+        int current; // profiler id of the stage being timed, -1 if none
+        int frame_id; // profiler id of the "frame" stage
+        bool in_frame; // a stage was started since the last call to next()
+        double t_stage, t_frame, t_first, t_last; // tick counts
+        unsigned long frames;
+
+        void end_stage(); // close the stage being timed and record its latency
+    public:
+        headlessRunner(int argc, char **argv); // constructor, parses --headless from the command line
+
+        bool is_headless() const { return headless; }
+        // Open 'device' (or 'file') normally, or the stream-th source given on the command line in headless mode
+        bool open(cv::VideoCapture &cap, int device, int stream = 0);
+        bool open(cv::VideoCapture &cap, const std::string &file, int stream = 0);
+        // File name of the stream-th source given on the command line, empty if there is none
+        std::string source(int stream) const { return stream < int(sources.size()) ? sources[stream] : std::string(); }
+        // Loop condition: finishes timing the previous frame, then waits for 'q' in GUI mode
+        // In headless mode it is always true, the loop must break when capture returns an empty frame
+        bool next();
+        // Profiler id of a named stage. Look ids up once, before the frame loop
+        int stage_id(const std::string &name) { return stageProfiler::instance().stage_id(name); }
+        // Start timing a stage of the current frame, ending the previous stage
+        void stage(int id);
+        // Same by name, looking the stage up on every call
+        void stage(const std::string &name) { stage(stage_id(name)); }
+        // imshow() unless headless
+        void show(const std::string &window, const cv::Mat &image);
+        // Print per-stage latency percentiles and sustained fps (headless mode only)
+        void report();
+};
+
+inline headlessRunner::headlessRunner(int argc, char **argv) {
+    headless = argc > 1 && std::string(argv[1]) == "--headless";
+    for(int i = 2; headless && i < argc; i++) sources.push_back(argv[i]);
+    if(headless && sources.empty())
+        std::cout << "Usage: " << argv[0] << " --headless <video file or image sequence> [...]" << std::endl;
+    current = -1;
+    frame_id = stageProfiler::instance().stage_id("frame");
+    in_frame = false;
+    t_stage = t_frame = t_first = t_last = 0;
+    frames = 0;
+}
+
+inline bool headlessRunner::open(cv::VideoCapture &cap, int device, int stream) {
+    if(!headless) return cap.open(device);
+    return stream < int(sources.size()) && cap.open(sources[stream]);
+}
+
+inline bool headlessRunner::open(cv::VideoCapture &cap, const std::string &file, int stream) {
+    if(!headless) return cap.open(file);
+    return stream < int(sources.size()) && cap.open(sources[stream]);
+}
+
+inline void headlessRunner::end_stage() {
+    if(current < 0) return;
+    double t = cv::getTickCount();
+    stageProfiler::instance().record(current, 1000 * (t - t_stage) / cv::getTickFrequency());
+    current = -1;
+}
+
+inline bool headlessRunner::next() {
+    end_stage();
+    double t = cv::getTickCount();
+    if(in_frame) {
+        frames++;
+        t_last = t;
+        stageProfiler::instance().record(frame_id, 1000 * (t - t_frame) / cv::getTickFrequency());
+    }
+    else if(frames == 0) t_first = t;
+    in_frame = false;
+    t_frame = t;
+
+    if(headless) return true;
+    return char(cv::waitKey(1)) != 'q';
+}
+
+inline void headlessRunner::stage(int id) {
+    end_stage();
+    current = id;
+    in_frame = true;
+    t_stage = cv::getTickCount();
+}
+
+inline void headlessRunner::show(const std::string &window, const cv::Mat &image) {
+    if(!headless) cv::imshow(window, image);
+}
+
+inline void headlessRunner::report() {
+    if(!headless) return;
+    // the stage running when the loop broke out (usually the capture that hit the end of the input) is not counted
+    current = -1;
+
+    double seconds = (t_last - t_first) / cv::getTickFrequency();
+    std::cout << "Processed " << frames << " frames in " << seconds << " s: " << (seconds > 0 ? frames / seconds : 0.) << " fps" << std::endl;
+    stageProfiler::instance().print(std::cout);
+}
+
+#endif
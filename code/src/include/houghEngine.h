@@ -0,0 +1,296 @@
+// Hough transforms that keep their accumulators between calls
+// HoughLines() and HoughCircles() find edges, vote and scan the votes for peaks on every call, although only the scan
+// depends on the accumulator threshold. houghEngine keeps the edges and the votes of the last image, for lines the
+// (angle, distance) accumulator and for circles the accumulator of centres voted along the gradient, and recomputes
+// them only when the image or the parameters they depend on change. A new threshold only rescans the peaks.
+// The results are those of HoughLines() with the standard transform and HoughCircles() with CV_HOUGH_GRADIENT
+// Line votes are cast in parallel, every thread taking a range of angles for all edge points
+
+#ifndef HOUGH_ENGINE_H
+#define HOUGH_ENGINE_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+class houghEngine {
+    private:
+        cv::Mat img; // current image
+
+        // lines
+        bool lines_valid; // accumulator is up to date
+        double rho, theta; // resolution of the accumulator
+        int line_canny_l, line_canny_h; // Canny thresholds of the edges
+        int numangle, numrho;
+        std::vector<int> line_acc; // votes of angle n and distance r at (n + 1) * (numrho + 2) + r + 1, with a border of 0
+
+        // circles
+        bool circles_valid;
+        double dp; // inverse resolution of the accumulator
+        int circle_canny, min_radius, max_radius;
+        int arows, acols;
+        std::vector<int> centre_acc; // votes of the centre (x, y) at y * (acols + 2) + x
+        std::vector<cv::Point> circle_points; // edge points with a gradient
+        std::vector<float> radius; // best radius of every centre accumulator cell already examined...
+        std::vector<int> support; // ...and the number of edge points at that radius, -1 if not examined yet
+
+        void vote_lines();
+        void vote_circles();
+        void estimate_radius(int, float, float); // radius of a centre and its support
+    public:
+        houghEngine();
+
+        // New image, the edges and accumulators are recomputed when next needed
+        void set_image(const cv::Mat &);
+        // Like HoughLines(Canny(image, canny_l, canny_h), lines, rho, theta, threshold)
+        void lines(std::vector<cv::Vec2f> &, int threshold, double rho = 1, double theta = CV_PI / 180, int canny_l = 50, int canny_h = 100);
+        // Like HoughCircles(gray image, circles, CV_HOUGH_GRADIENT, dp, min_dist, canny, threshold, min_radius, max_radius)
+        void circles(std::vector<cv::Vec3f> &, int threshold, double dp = 1, double min_dist = 10, int canny = 200, int min_radius = 5, int max_radius = 0);
+};
+
+// Casts the votes of a range of angles for all edge points. Each angle is one row of the accumulator, so threads never
+// write to the same cells and need neither private accumulators nor a merge, and the row being filled stays in cache.
+// Distances are computed for blocks of points in a loop the compiler vectorizes, then added to the row
+class houghLineVotes : public cv::ParallelLoopBody {
+    private:
+        const float *x, *y; // edge points
+        int n;
+        const float *tab_cos, *tab_sin; // cos and sin of every angle, divided by the distance resolution
+        int numrho;
+        int *acc;
+    public:
+        houghLineVotes(const float *_x, const float *_y, int _n, const float *_tab_cos, const float *_tab_sin, int _numrho, int *_acc) {
+            x = _x;
+            y = _y;
+            n = _n;
+            tab_cos = _tab_cos;
+            tab_sin = _tab_sin;
+            numrho = _numrho;
+            acc = _acc;
+        }
+        void operator()(const cv::Range &range) const {
+            const int BLOCK = 256;
+            int r[BLOCK];
+            for(int a = range.start; a < range.end; a++) {
+                int *row = acc + (a + 1) * (numrho + 2) + 1 + (numrho - 1) / 2;
+                float c = tab_cos[a], s = tab_sin[a];
+                for(int i0 = 0; i0 < n; i0 += BLOCK) {
+                    int m = std::min(BLOCK, n - i0);
+                    // Adding 1.5 * 2^23 leaves the distance rounded to the nearest integer (ties to even, as cvRound())
+                    // in the low bits of the mantissa, for distances up to 2^22
+                    for(int i = 0; i < m; i++) {
+                        float t = x[i0 + i] * c + y[i0 + i] * s + 12582912.f;
+                        int bits;
+                        memcpy(&bits, &t, sizeof(bits));
+                        r[i] = bits - 0x4B400000;
+                    }
+                    for(int i = 0; i < m; i++) row[r[i]]++;
+                }
+            }
+        }
+};
+
+// Orders accumulator cells by decreasing votes, then by position
+struct houghGreater {
+    const int *acc;
+    houghGreater(const int *_acc) { acc = _acc; }
+    bool operator()(int a, int b) const { return acc[a] > acc[b] || (acc[a] == acc[b] && a < b); }
+};
+
+inline houghEngine::houghEngine() {
+    lines_valid = circles_valid = false;
+    rho = theta = dp = 0;
+    line_canny_l = line_canny_h = circle_canny = min_radius = max_radius = -1;
+    numangle = numrho = arows = acols = 0;
+}
+
+inline void houghEngine::set_image(const cv::Mat &_img) {
+    img = _img;
+    lines_valid = circles_valid = false;
+}
+
+inline void houghEngine::vote_lines() {
+    cv::Mat edges;
+    cv::Canny(img, edges, line_canny_l, line_canny_h);
+
+    numangle = cvRound(CV_PI / theta);
+    numrho = cvRound(((edges.cols + edges.rows) * 2 + 1) / rho);
+    line_acc.assign((numangle + 2) * (numrho + 2), 0);
+    std::vector<float> tab_sin(numangle), tab_cos(numangle);
+    float ang = 0;
+    for(int n = 0; n < numangle; n++, ang += (float)theta) {
+        tab_sin[n] = (float)(sin((double)ang) / rho);
+        tab_cos[n] = (float)(cos((double)ang) / rho);
+    }
+
+    // edge points as separate x and y arrays
+    std::vector<float> x, y;
+    for(int i = 0; i < edges.rows; i++) {
+        const uchar *row = edges.ptr<uchar>(i);
+        for(int j = 0; j < edges.cols; j++) {
+            if(!row[j]) continue;
+            x.push_back(j);
+            y.push_back(i);
+        }
+    }
+    if(!x.empty())
+        cv::parallel_for_(cv::Range(0, numangle), houghLineVotes(&x[0], &y[0], x.size(), &tab_cos[0], &tab_sin[0], numrho, &line_acc[0]));
+    lines_valid = true;
+}
+
+inline void houghEngine::lines(std::vector<cv::Vec2f> &lines, int threshold, double _rho, double _theta, int canny_l, int canny_h) {
+    if(!lines_valid || _rho != rho || _theta != theta || canny_l != line_canny_l || canny_h != line_canny_h) {
+        rho = _rho;
+        theta = _theta;
+        line_canny_l = canny_l;
+        line_canny_h = canny_h;
+        vote_lines();
+    }
+
+    // local maxima above the threshold, strongest first
+    const int *acc = &line_acc[0];
+    std::vector<int> peaks;
+    for(int r = 0; r < numrho; r++) {
+        for(int n = 0; n < numangle; n++) {
+            int base = (n + 1) * (numrho + 2) + r + 1;
+            if(acc[base] > threshold && acc[base] > acc[base - 1] && acc[base] >= acc[base + 1] &&
+               acc[base] > acc[base - numrho - 2] && acc[base] >= acc[base + numrho + 2])
+                peaks.push_back(base);
+        }
+    }
+    std::sort(peaks.begin(), peaks.end(), houghGreater(acc));
+
+    lines.resize(peaks.size());
+    for(int i = 0; i < peaks.size(); i++) {
+        int n = peaks[i] / (numrho + 2) - 1, r = peaks[i] - (n + 1) * (numrho + 2) - 1;
+        lines[i] = cv::Vec2f((r - (numrho - 1) * 0.5f) * rho, n * theta);
+    }
+}
+
+inline void houghEngine::vote_circles() {
+    cv::Mat gray = img, edges, dx, dy;
+    if(img.channels() == 3) cv::cvtColor(img, gray, CV_BGR2GRAY);
+    cv::Canny(gray, edges, std::max(circle_canny / 2, 1), circle_canny);
+    cv::Sobel(gray, dx, CV_16S, 1, 0, 3);
+    cv::Sobel(gray, dy, CV_16S, 0, 1, 3);
+
+    // every edge point votes for the centres along its gradient, in both directions, from min_radius to max_radius
+    const int SHIFT = 10, ONE = 1 << SHIFT;
+    double idp = 1 / dp;
+    arows = cvCeil(gray.rows * idp);
+    acols = cvCeil(gray.cols * idp);
+    int astep = acols + 2;
+    centre_acc.assign((arows + 2) * astep, 0);
+    circle_points.clear();
+    for(int y = 0; y < gray.rows; y++) {
+        const uchar *e = edges.ptr<uchar>(y);
+        const short *gx = dx.ptr<short>(y), *gy = dy.ptr<short>(y);
+        for(int x = 0; x < gray.cols; x++) {
+            float vx = gx[x], vy = gy[x];
+            if(!e[x] || (vx == 0 && vy == 0)) continue;
+
+            float mag = std::sqrt(vx * vx + vy * vy);
+            int sx = cvRound((vx * idp) * ONE / mag), sy = cvRound((vy * idp) * ONE / mag);
+            int x0 = cvRound((x * idp) * ONE), y0 = cvRound((y * idp) * ONE);
+            for(int k = 0; k < 2; k++) {
+                int x1 = x0 + min_radius * sx, y1 = y0 + min_radius * sy;
+                for(int r = min_radius; r <= max_radius; x1 += sx, y1 += sy, r++) {
+                    int x2 = x1 >> SHIFT, y2 = y1 >> SHIFT;
+                    if((unsigned)x2 >= (unsigned)acols || (unsigned)y2 >= (unsigned)arows) break;
+                    centre_acc[y2 * astep + x2]++;
+                }
+                sx = -sx;
+                sy = -sy;
+            }
+            circle_points.push_back(cv::Point(x, y));
+        }
+    }
+
+    radius.assign(centre_acc.size(), 0);
+    support.assign(centre_acc.size(), -1);
+    circles_valid = true;
+}
+
+inline void houghEngine::estimate_radius(int ofs, float cx, float cy) {
+    // distances of the edge points within the radius range, then the densest run of distances no wider than dp
+    std::vector<float> d;
+    float min_r2 = float(min_radius) * min_radius, max_r2 = float(max_radius) * max_radius;
+    for(int j = 0; j < circle_points.size(); j++) {
+        float _dx = cx - circle_points[j].x, _dy = cy - circle_points[j].y, r2 = _dx * _dx + _dy * _dy;
+        if(min_r2 <= r2 && r2 <= max_r2) d.push_back(std::sqrt(r2));
+    }
+    float r_best = 0;
+    int max_count = 0, n = d.size();
+    if(n > 0) {
+        std::sort(d.begin(), d.end(), std::greater<float>());
+        int start_idx = n - 1;
+        float start_dist = d[n - 1];
+        for(int j = n - 2; j >= 0; j--) {
+            if(d[j] > max_radius) break;
+            if(d[j] - start_dist > dp) {
+                float r_cur = d[(j + start_idx) / 2];
+                if((start_idx - j) * r_best >= max_count * r_cur || (r_best < FLT_EPSILON && start_idx - j >= max_count)) {
+                    r_best = r_cur;
+                    max_count = start_idx - j;
+                }
+                start_dist = d[j];
+                start_idx = j;
+            }
+        }
+    }
+    radius[ofs] = r_best;
+    support[ofs] = max_count;
+}
+
+inline void houghEngine::circles(std::vector<cv::Vec3f> &circles, int threshold, double _dp, double min_dist, int canny, int _min_radius, int _max_radius) {
+    _dp = std::max(_dp, 1.);
+    _min_radius = std::max(_min_radius, 0);
+    if(_max_radius <= 0) _max_radius = std::max(img.rows, img.cols);
+    else if(_max_radius <= _min_radius) _max_radius = _min_radius + 2;
+    if(!circles_valid || _dp != dp || canny != circle_canny || _min_radius != min_radius || _max_radius != max_radius) {
+        dp = _dp;
+        circle_canny = canny;
+        min_radius = _min_radius;
+        max_radius = _max_radius;
+        vote_circles();
+    }
+
+    circles.clear();
+    if(circle_points.empty()) return;
+
+    // local maxima above the threshold, strongest first
+    const int *acc = &centre_acc[0];
+    int astep = acols + 2;
+    std::vector<int> centres;
+    for(int y = 1; y < arows - 1; y++) {
+        for(int x = 1; x < acols - 1; x++) {
+            int base = y * astep + x;
+            if(acc[base] > threshold && acc[base] > acc[base - 1] && acc[base] > acc[base + 1] &&
+               acc[base] > acc[base - astep] && acc[base] > acc[base + astep])
+                centres.push_back(base);
+        }
+    }
+    std::sort(centres.begin(), centres.end(), houghGreater(acc));
+
+    // keep the centres far enough from stronger ones with enough edge points at their best radius. The radius of a
+    // centre does not depend on the threshold, so it is estimated once and reused by the following calls
+    min_dist = std::max(min_dist, dp);
+    min_dist *= min_dist;
+    for(int i = 0; i < centres.size(); i++) {
+        int y = centres[i] / astep, x = centres[i] - y * astep;
+        float cx = (float)((x + 0.5f) * dp), cy = (float)((y + 0.5f) * dp);
+        bool near = false;
+        for(int j = 0; j < circles.size() && !near; j++)
+            near = (circles[j][0] - cx) * (circles[j][0] - cx) + (circles[j][1] - cy) * (circles[j][1] - cy) < min_dist;
+        if(near) continue;
+
+        if(support[centres[i]] < 0) estimate_radius(centres[i], cx, cy);
+        if(support[centres[i]] > threshold) circles.push_back(cv::Vec3f(cx, cy, radius[centres[i]]));
+    }
+}
+
+#endif
@@ -0,0 +1,159 @@
+// Filter front end for arbitrary kernels
+// filter2D() applies every kernel as a full 2D correlation, costing kernel width * height operations per pixel even
+// when the kernel is a product of a column and a row (like the edge kernels of code5-1). kernelFilter decomposes the
+// kernel once with an SVD: a kernel of rank r is the sum of r outer products of a column and a row, so it can be
+// applied as r pairs of 1D passes costing r * (width + height). Large kernels of high rank are applied by multiplying
+// spectra instead. For every image size a cost model picks the cheapest of the three ways
+// (direct, separable, DFT); its weights can be tuned with chapter5/filter_benchmark
+
+#ifndef KERNEL_FILTER_H
+#define KERNEL_FILTER_H
+
+#include <opencv2/opencv.hpp>
+#include <cmath>
+#include <vector>
+
+class kernelFilter {
+    private:
+        cv::Mat kernel; // CV_32F
+        cv::Point anchor;
+        std::vector<cv::Mat> cols, rows; // kernel = sum of cols[k] * rows[k], cols[k] being kh x 1 and rows[k] 1 x kw
+        cv::Mat spectrum; // DFT of the kernel for images padded to spectrum_size
+        cv::Size spectrum_size;
+
+        void direct(const cv::Mat &, cv::Mat &, int, int) const;
+        void separable(const cv::Mat &, cv::Mat &, int, int) const;
+        void fourier(const cv::Mat &, cv::Mat &, int, int);
+    public:
+        enum {AUTO = -1, DIRECT = 0, SEPARABLE = 1, DFT = 2};
+
+        // cost model weights, in multiply-adds per pixel
+        double pass_weight; // one extra pass over the image (accumulating separable terms, converting)
+        double dft_weight; // one transform, per pixel and per log2 of the transform area
+
+        kernelFilter() {pass_weight = 2; dft_weight = 3;}
+        kernelFilter(const cv::Mat &_kernel, cv::Point _anchor = cv::Point(-1, -1), double tolerance = 1e-5) {
+            pass_weight = 2;
+            dft_weight = 3;
+            set_kernel(_kernel, _anchor, tolerance);
+        }
+
+        // Decompose a kernel, dropping the terms whose singular value is below tolerance times the largest
+        void set_kernel(const cv::Mat &, cv::Point = cv::Point(-1, -1), double tolerance = 1e-5);
+        int get_rank() const {return cols.size();}
+        double cost(int method, cv::Size size) const; // estimated multiply-adds per pixel and channel
+        int choose(cv::Size size) const; // cheapest method for images of a size
+        // Correlate an image with the kernel like filter2D(), by the given method or the cheapest one
+        void apply(const cv::Mat &src, cv::Mat &dst, int ddepth = -1, int method = AUTO, int border = cv::BORDER_DEFAULT);
+};
+
+inline void kernelFilter::set_kernel(const cv::Mat &_kernel, cv::Point _anchor, double tolerance) {
+    CV_Assert(_kernel.channels() == 1 && !_kernel.empty());
+    _kernel.convertTo(kernel, CV_32F);
+    anchor = cv::Point(_anchor.x < 0 ? kernel.cols / 2 : _anchor.x, _anchor.y < 0 ? kernel.rows / 2 : _anchor.y);
+    spectrum.release();
+    spectrum_size = cv::Size();
+
+    // kernel = u * diag(w) * vt, so term k is column k of u times row k of vt, both scaled by sqrt(w[k])
+    cv::Mat k64, w, u, vt;
+    kernel.convertTo(k64, CV_64F);
+    cv::SVD::compute(k64, w, u, vt);
+    cols.clear();
+    rows.clear();
+    for(int k = 0; k < w.rows; k++) {
+        double s = w.at<double>(k);
+        if(s <= tolerance * w.at<double>(0) || s == 0) break;
+        cv::Mat c, r;
+        u.col(k).convertTo(c, CV_32F, std::sqrt(s));
+        vt.row(k).convertTo(r, CV_32F, std::sqrt(s));
+        cols.push_back(c);
+        rows.push_back(r);
+    }
+}
+
+inline double kernelFilter::cost(int method, cv::Size size) const {
+    int kw = kernel.cols, kh = kernel.rows, r = get_rank();
+    if(method == DIRECT) return kw * kh;
+    if(method == SEPARABLE) return r == 0 ? pass_weight : r * (kw + kh) + (r > 1 ? r * pass_weight : 0);
+
+    // forward and inverse transform of the padded image, per pixel of the image, plus the product of the spectra
+    double area = double(cv::getOptimalDFTSize(size.width + kw - 1)) * cv::getOptimalDFTSize(size.height + kh - 1);
+    double log_area = std::log(area) / std::log(2.);
+    return (2 * dft_weight * log_area + 6) * area / size.area() + 2 * pass_weight;
+}
+
+inline int kernelFilter::choose(cv::Size size) const {
+    int best = DIRECT;
+    for(int m = SEPARABLE; m <= DFT; m++)
+        if(cost(m, size) < cost(best, size)) best = m;
+    return best;
+}
+
+inline void kernelFilter::apply(const cv::Mat &src, cv::Mat &dst, int ddepth, int method, int border) {
+    CV_Assert(!kernel.empty());
+    if(ddepth < 0) ddepth = src.depth();
+    if(method == AUTO) method = choose(src.size());
+    if(method == SEPARABLE) separable(src, dst, ddepth, border);
+    else if(method == DFT) fourier(src, dst, ddepth, border);
+    else direct(src, dst, ddepth, border);
+}
+
+inline void kernelFilter::direct(const cv::Mat &src, cv::Mat &dst, int ddepth, int border) const {
+    cv::filter2D(src, dst, ddepth, kernel, anchor, 0, border);
+}
+
+inline void kernelFilter::separable(const cv::Mat &src, cv::Mat &dst, int ddepth, int border) const {
+    if(cols.empty()) { // all zero kernel
+        dst.create(src.size(), CV_MAKETYPE(ddepth, src.channels()));
+        dst.setTo(cv::Scalar::all(0));
+        return;
+    }
+    if(cols.size() == 1) {
+        cv::sepFilter2D(src, dst, ddepth, rows[0], cols[0], anchor, 0, border);
+        return;
+    }
+    // sum of the terms in float, rounded once at the end
+    cv::Mat sum, term;
+    cv::sepFilter2D(src, sum, CV_32F, rows[0], cols[0], anchor, 0, border);
+    for(int k = 1; k < cols.size(); k++) {
+        cv::sepFilter2D(src, term, CV_32F, rows[k], cols[k], anchor, 0, border);
+        sum += term;
+    }
+    sum.convertTo(dst, ddepth);
+}
+
+inline void kernelFilter::fourier(const cv::Mat &src, cv::Mat &dst, int ddepth, int border) {
+    int kw = kernel.cols, kh = kernel.rows;
+    cv::Size padded_size(src.cols + kw - 1, src.rows + kh - 1);
+    cv::Size dft_size(cv::getOptimalDFTSize(padded_size.width), cv::getOptimalDFTSize(padded_size.height));
+
+    // the spectrum of the kernel only depends on the transform size, so it is kept for images of the same size
+    if(dft_size != spectrum_size) {
+        cv::Mat k = cv::Mat::zeros(dft_size, CV_32F);
+        cv::Mat k_roi = k(cv::Rect(0, 0, kw, kh));
+        kernel.copyTo(k_roi);
+        cv::dft(k, spectrum, 0, kh);
+        spectrum_size = dft_size;
+    }
+
+    // correlation is the inverse transform of the image spectrum times the conjugate kernel spectrum. The borders
+    // are added first, so output pixel (x, y) is correlation pixel (x, y) and the wrap around only touches the rest
+    cv::Mat padded;
+    cv::copyMakeBorder(src, padded, anchor.y, kh - 1 - anchor.y, anchor.x, kw - 1 - anchor.x, border & ~cv::BORDER_ISOLATED);
+    std::vector<cv::Mat> channels;
+    cv::split(padded, channels);
+    std::vector<cv::Mat> out(channels.size());
+    cv::Mat plane = cv::Mat::zeros(dft_size, CV_32F), product;
+    cv::Mat plane_roi = plane(cv::Rect(0, 0, padded_size.width, padded_size.height));
+    for(int c = 0; c < channels.size(); c++) {
+        channels[c].convertTo(plane_roi, CV_32F);
+        cv::dft(plane, plane, 0, padded_size.height);
+        cv::mulSpectrums(plane, spectrum, product, 0, true);
+        cv::dft(product, product, cv::DFT_INVERSE | cv::DFT_SCALE | cv::DFT_REAL_OUTPUT, src.rows);
+        product(cv::Rect(0, 0, src.cols, src.rows)).convertTo(out[c], ddepth);
+        plane.setTo(cv::Scalar::all(0));
+    }
+    cv::merge(out, dst);
+}
+
+#endif
@@ -0,0 +1,300 @@
+// Erosion and dilation in time independent of the structuring element size
+// erode() and dilate() compare every pixel with every element of the structuring element, so large elements (like
+// the 19x19 ellipse of code7-3) are slow. The van Herk/Gil-Werman algorithm finds the minimum (or maximum) over a
+// window of any length w with 3 comparisons per pixel: the rows are cut into blocks of w, running minima are
+// computed forwards and backwards inside each block, and every window spans the end of one block and the start of
+// the next, so its minimum is that of one backward and one forward running minimum.
+// - a rectangle is a vertical window followed by a horizontal one
+// - any other element whose rows are single runs (ellipses, crosses) is the union of one horizontal line per row. The
+//   lines of every length are computed from the next shorter one with one comparison (a line of length l is two
+//   overlapping lines of length l' >= l / 2), and then shifted and combined
+// Windows along rows are computed on the transposed image, so that every comparison is between whole rows, 16 bytes
+// at a time with SSE2, and bands of rows (or strips of columns) are processed in parallel. Pixels outside the image
+// are ignored, like erode() and dilate() do by default, so the results are identical
+
+#ifndef MORPHOLOGY_ENGINE_H
+#define MORPHOLOGY_ENGINE_H
+
+#include <opencv2/opencv.hpp>
+#include <algorithm>
+#include <cstring>
+#include <vector>
+#if defined __SSE2__ || defined _M_X64 || (defined _M_IX86_FP && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define MORPHOLOGY_ENGINE_SSE2 1
+#endif
+
+// Elements with both sides below this are left to erode() and dilate(), whose vectorized loops are faster there
+const int morph_min_size = 7;
+
+// Minimum for erosion
+struct morphMin {
+    enum {identity = 255}; // value of the pixels outside the image
+    static uchar apply(uchar a, uchar b) {return std::min(a, b);}
+#ifdef MORPHOLOGY_ENGINE_SSE2
+    static __m128i apply(__m128i a, __m128i b) {return _mm_min_epu8(a, b);}
+#endif
+};
+
+// Maximum for dilation
+struct morphMax {
+    enum {identity = 0};
+    static uchar apply(uchar a, uchar b) {return std::max(a, b);}
+#ifdef MORPHOLOGY_ENGINE_SSE2
+    static __m128i apply(__m128i a, __m128i b) {return _mm_max_epu8(a, b);}
+#endif
+};
+
+// out[i] = Op(a[i], b[i]) for n bytes. out may be a or b
+template<class Op> inline void morph_combine(const uchar *a, const uchar *b, uchar *out, int n) {
+    int i = 0;
+#ifdef MORPHOLOGY_ENGINE_SSE2
+    for(; i <= n - 16; i += 16)
+        _mm_storeu_si128((__m128i *)(out + i), Op::apply(_mm_loadu_si128((const __m128i *)(a + i)), _mm_loadu_si128((const __m128i *)(b + i))));
+#endif
+    for(; i < n; i++) out[i] = Op::apply(a[i], b[i]);
+}
+
+// Vertical windows by van Herk/Gil-Werman on strips of columns: row y of dst is Op over rows y - a to y - a + w - 1
+// of src, which need not have as many rows as dst
+template<class Op> class morphWindows : public cv::ParallelLoopBody {
+    private:
+        const cv::Mat *src;
+        cv::Mat *dst;
+        int w, a, strip;
+    public:
+        morphWindows(const cv::Mat *_src, cv::Mat *_dst, int _w, int _a, int _strip) {
+            src = _src;
+            dst = _dst;
+            w = _w;
+            a = _a;
+            strip = _strip;
+        }
+        void operator()(const cv::Range &range) const {
+            int bytes = src->cols * src->elemSize(), n = dst->rows + w - 1;
+            std::vector<uchar> g(n * strip), h(n * strip), border(strip, uchar(Op::identity));
+            std::vector<const uchar *> row(n);
+            for(int s = range.start; s < range.end; s++) {
+                int x0 = s * strip, sw = std::min(strip, bytes - x0);
+                // row i of the window sequence is row i - a of src, pixels outside it being ignored
+                for(int i = 0; i < n; i++) row[i] = i - a >= 0 && i - a < src->rows ? src->ptr<uchar>(i - a) + x0 : &border[0];
+
+                // running Op forwards and backwards inside blocks of w rows
+                for(int i = 0; i < n; i++) {
+                    if(i % w == 0) memcpy(&g[i * strip], row[i], sw);
+                    else morph_combine<Op>(&g[(i - 1) * strip], row[i], &g[i * strip], sw);
+                }
+                for(int i = n - 1; i >= 0; i--) {
+                    if(i == n - 1 || i % w == w - 1) memcpy(&h[i * strip], row[i], sw);
+                    else morph_combine<Op>(&h[(i + 1) * strip], row[i], &h[i * strip], sw);
+                }
+
+                // window y..y + w - 1 is the end of the block of y and the start of the block of y + w - 1
+                for(int y = 0; y < dst->rows; y++) morph_combine<Op>(&h[y * strip], &g[(y + w - 1) * strip], dst->ptr<uchar>(y) + x0, sw);
+            }
+        }
+};
+
+// dst row y = Op over src rows y - a .. y - a + w - 1, with dst having 'rows' rows
+template<class Op> inline void morph_windows(const cv::Mat &src, cv::Mat &dst, int rows, int w, int a) {
+    dst.create(rows, src.cols, src.type());
+    int strip = 64, bytes = src.cols * src.elemSize();
+    cv::parallel_for_(cv::Range(0, (bytes + strip - 1) / strip), morphWindows<Op>(&src, &dst, w, a, strip));
+}
+
+// Lines of length len from lines of length prev: row k is Op of rows k and k + len - prev of the shorter lines
+template<class Op> class morphLonger : public cv::ParallelLoopBody {
+    private:
+        const cv::Mat *shorter;
+        cv::Mat *longer;
+        int d;
+    public:
+        morphLonger(const cv::Mat *_shorter, cv::Mat *_longer, int _d) {
+            shorter = _shorter;
+            longer = _longer;
+            d = _d;
+        }
+        void operator()(const cv::Range &range) const {
+            int bytes = shorter->cols * shorter->elemSize();
+            for(int k = range.start; k < range.end; k++) {
+                if(k + d < shorter->rows) morph_combine<Op>(shorter->ptr<uchar>(k), shorter->ptr<uchar>(k + d), longer->ptr<uchar>(k), bytes);
+                else memcpy(longer->ptr<uchar>(k), shorter->ptr<uchar>(k), bytes);
+            }
+        }
+};
+
+// One horizontal line of a structuring element, relative to the anchor
+struct morphLine {
+    int dy, dx, len; // covers (dx .. dx + len - 1, dy)
+    int index; // of the lines of its length
+};
+
+// Combines the shifted lines into the transposed result: row x of dst is Op over the lines of row x + dx of their
+// line image, shifted by dy pixels
+template<class Op> class morphCombineLines : public cv::ParallelLoopBody {
+    private:
+        const std::vector<cv::Mat> *images;
+        const std::vector<morphLine> *lines;
+        cv::Mat *dst;
+        int pad;
+    public:
+        morphCombineLines(const std::vector<cv::Mat> *_images, const std::vector<morphLine> *_lines, cv::Mat *_dst, int _pad) {
+            images = _images;
+            lines = _lines;
+            dst = _dst;
+            pad = _pad;
+        }
+        void operator()(const cv::Range &range) const {
+            int cn = dst->elemSize(), bytes = dst->cols * cn;
+            for(int x = range.start; x < range.end; x++) {
+                uchar *out = dst->ptr<uchar>(x);
+                memset(out, Op::identity, bytes);
+                for(int l = 0; l < lines->size(); l++) {
+                    const morphLine &line = (*lines)[l];
+                    const uchar *in = (*images)[line.index].ptr<uchar>(x + line.dx + pad);
+                    int o = line.dy * cn;
+                    if(o >= bytes || -o >= bytes) continue;
+                    if(o >= 0) morph_combine<Op>(out, in + o, out, bytes - o);
+                    else morph_combine<Op>(out - o, in, out - o, bytes + o);
+                }
+            }
+        }
+};
+
+// Rows of a structuring element as lines, false if a row is not a single run
+inline bool morph_lines(const cv::Mat &strel, cv::Point anchor, std::vector<morphLine> &lines) {
+    lines.clear();
+    for(int r = 0; r < strel.rows; r++) {
+        int start = -1, end = -1;
+        for(int c = 0; c < strel.cols; c++) {
+            if(!strel.at<uchar>(r, c)) continue;
+            if(start >= 0 && end != c - 1) return false;
+            if(start < 0) start = c;
+            end = c;
+        }
+        if(start < 0) continue;
+        morphLine line;
+        line.dy = r - anchor.y;
+        line.dx = start - anchor.x;
+        line.len = end - start + 1;
+        line.index = -1;
+        lines.push_back(line);
+    }
+    return !lines.empty();
+}
+
+// Erosion (morphMin) or dilation (morphMax) of an 8 bit image by any element whose rows are single runs, once.
+// Returns false, leaving dst alone, if the image or element is not supported
+template<class Op> inline bool morph_engine(const cv::Mat &_src, cv::Mat &dst, const cv::Mat &_strel, cv::Point anchor = cv::Point(-1, -1)) {
+    cv::Mat strel;
+    _strel.convertTo(strel, CV_8U);
+    if(_src.depth() != CV_8U || strel.empty()) return false;
+    if(anchor.x < 0) anchor.x = strel.cols / 2;
+    if(anchor.y < 0) anchor.y = strel.rows / 2;
+    std::vector<morphLine> lines;
+    if(!morph_lines(strel, anchor, lines)) return false;
+    cv::Mat src = _src.data == dst.data ? _src.clone() : _src;
+
+    // a rectangle is every row having the same line with no row missing in between
+    bool rectangle = true;
+    for(int l = 1; l < lines.size(); l++)
+        if(lines[l].dx != lines[0].dx || lines[l].len != lines[0].len || lines[l].dy != lines[l - 1].dy + 1) rectangle = false;
+    if(rectangle) {
+        cv::Mat v, t, h;
+        int height = lines.size(), width = lines[0].len;
+        if(height > 1 || lines[0].dy != 0) morph_windows<Op>(src, v, src.rows, height, -lines[0].dy);
+        else v = src;
+        if(width == 1 && lines[0].dx == 0) {
+            v.copyTo(dst);
+            return true;
+        }
+        cv::transpose(v, t);
+        morph_windows<Op>(t, h, t.rows, width, -lines[0].dx);
+        cv::transpose(h, dst);
+        return true;
+    }
+
+    // lines of every length on the transposed image, padded so that row k is the line starting at column k - pad
+    cv::Mat t;
+    cv::transpose(src, t);
+    int pad = 0, rows = 0;
+    for(int l = 0; l < lines.size(); l++) {
+        pad = std::max(pad, -lines[l].dx);
+        rows = std::max(rows, lines[l].dx + lines[l].len - 1);
+    }
+    rows = pad + t.rows + std::max(rows, 0);
+
+    std::vector<int> lens;
+    for(int l = 0; l < lines.size(); l++) lens.push_back(lines[l].len);
+    std::sort(lens.begin(), lens.end());
+    lens.erase(std::unique(lens.begin(), lens.end()), lens.end());
+    std::vector<cv::Mat> images(lens.size());
+    for(int i = 0; i < lens.size(); i++) {
+        if(i > 0 && lens[i] <= 2 * lens[i - 1]) {
+            images[i].create(rows, t.cols, t.type());
+            cv::parallel_for_(cv::Range(0, rows), morphLonger<Op>(&images[i - 1], &images[i], lens[i] - lens[i - 1]));
+        }
+        else morph_windows<Op>(t, images[i], rows, lens[i], pad);
+    }
+    for(int l = 0; l < lines.size(); l++) lines[l].index = std::lower_bound(lens.begin(), lens.end(), lines[l].len) - lens.begin();
+
+    cv::Mat out(t.size(), t.type());
+    cv::parallel_for_(cv::Range(0, t.rows), morphCombineLines<Op>(&images, &lines, &out, pad));
+    cv::transpose(out, dst);
+    return true;
+}
+
+// Drop-in replacements for erode(), dilate() and morphologyEx() with the default border
+inline void fast_erode(const cv::Mat &src, cv::Mat &dst, const cv::Mat &strel, cv::Point anchor = cv::Point(-1, -1), int iterations = 1) {
+    if(std::max(strel.rows, strel.cols) < morph_min_size) {
+        cv::erode(src, dst, strel, anchor, iterations);
+        return;
+    }
+    const cv::Mat *in = &src;
+    for(int i = 0; i < iterations; i++, in = &dst) {
+        if(!morph_engine<morphMin>(*in, dst, strel, anchor)) {
+            cv::erode(*in, dst, strel, anchor, iterations - i);
+            return;
+        }
+    }
+    if(iterations <= 0) src.copyTo(dst);
+}
+
+inline void fast_dilate(const cv::Mat &src, cv::Mat &dst, const cv::Mat &strel, cv::Point anchor = cv::Point(-1, -1), int iterations = 1) {
+    if(std::max(strel.rows, strel.cols) < morph_min_size) {
+        cv::dilate(src, dst, strel, anchor, iterations);
+        return;
+    }
+    const cv::Mat *in = &src;
+    for(int i = 0; i < iterations; i++, in = &dst) {
+        if(!morph_engine<morphMax>(*in, dst, strel, anchor)) {
+            cv::dilate(*in, dst, strel, anchor, iterations - i);
+            return;
+        }
+    }
+    if(iterations <= 0) src.copyTo(dst);
+}
+
+inline void fast_morphologyEx(const cv::Mat &src, cv::Mat &dst, int op, const cv::Mat &strel, cv::Point anchor = cv::Point(-1, -1),
+                              int iterations = 1) {
+    switch(op) {
+        case cv::MORPH_ERODE:
+            fast_erode(src, dst, strel, anchor, iterations);
+            break;
+        case cv::MORPH_DILATE:
+            fast_dilate(src, dst, strel, anchor, iterations);
+            break;
+        case cv::MORPH_OPEN:
+            fast_erode(src, dst, strel, anchor, iterations);
+            fast_dilate(dst, dst, strel, anchor, iterations);
+            break;
+        case cv::MORPH_CLOSE:
+            fast_dilate(src, dst, strel, anchor, iterations);
+            fast_erode(dst, dst, strel, anchor, iterations);
+            break;
+        default:
+            cv::morphologyEx(src, dst, op, strel, anchor, iterations);
+    }
+}
+
+#endif
@@ -0,0 +1,279 @@
+// Lightweight per-stage profiler shared by the programs of all chapters
+// Stages (capture, convert, detect, ...) are timed with scopedTimer objects. Every thread accumulates its samples
+// into its own latency histograms without taking any lock, and a background thread started with start_dump()
+// periodically writes the count, rate, mean, p50, p95 and p99 of every stage in the last interval to a CSV or JSON file
+// Programs including this header must be linked with -lboost_thread -lboost_system
+
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#include <opencv2/opencv.hpp>
+#include <boost/thread.hpp>
+#include <boost/atomic.hpp>
+#include <cmath>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <string>
+#include <vector>
+
+// Latency histogram of one stage: 8 logarithmic buckets per octave from 1 us to about 1000 s,
+// so that reported percentiles are within about 6% of the true value
+class latencyHistogram {
+    public:
+        enum { SUB = 8, OCTAVES = 31, BINS = SUB * OCTAVES };
+        unsigned long long counts[BINS];
+        unsigned long long count;
+        double sum_ms;
+
+        latencyHistogram() { clear(); }
+        void clear() {
+            for(int i = 0; i < BINS; i++) counts[i] = 0;
+            count = 0;
+            sum_ms = 0;
+        }
+
+        static int bin(double ms) {
+            int e;
+            double m = frexp(ms * 1000, &e); // microseconds = m * 2^e, m in [0.5, 1)
+            if(e < 1) return 0;
+            if(e > OCTAVES) return BINS - 1;
+            return (e - 1) * SUB + int((m - 0.5) * 2 * SUB);
+        }
+        static double bin_center(int b) { // in ms
+            return ldexp(0.5 + (b % SUB + 0.5) / (2 * SUB), b / SUB + 1) / 1000;
+        }
+
+        double percentile(double p) const {
+            if(count == 0) return 0;
+            unsigned long long rank = (unsigned long long)(p * count + 0.5), seen = 0;
+            if(rank < 1) rank = 1;
+            for(int i = 0; i < BINS; i++) {
+                seen += counts[i];
+                if(seen >= rank) return bin_center(i);
+            }
+            return bin_center(BINS - 1);
+        }
+        double mean() const { return count ? sum_ms / count : 0; }
+};
+
+class stageProfiler {
+    public:
+        enum { MAX_STAGES = 32 };
+    private:
+        // Samples of one thread. Only the owning thread writes, so relaxed loads and stores are enough,
+        // the dump thread reads them concurrently and may see a sample one interval late
+        struct threadData {
+            boost::atomic<unsigned long long> counts[MAX_STAGES][latencyHistogram::BINS];
+            boost::atomic<unsigned long long> sum_us[MAX_STAGES];
+            threadData() {
+                for(int s = 0; s < MAX_STAGES; s++) {
+                    for(int i = 0; i < latencyHistogram::BINS; i++) counts[s][i].store(0, boost::memory_order_relaxed);
+                    sum_us[s].store(0, boost::memory_order_relaxed);
+                }
+            }
+        };
+
+        static void no_cleanup(threadData *) {} // thread data outlives its thread, it is owned by 'threads'
+        boost::thread_specific_ptr<threadData> local;
+
+        boost::mutex mtx; // guards registration of threads and stages, taken by record() only on the first call of each thread
+        std::vector<threadData *> threads;
+        std::string names[MAX_STAGES];
+        boost::atomic<int> n_stages;
+
+        // dump thread
+        boost::thread dumper;
+        boost::mutex dump_mtx;
+        boost::condition_variable dump_cv;
+        bool dumping;
+        std::ofstream out;
+        bool json;
+        double period, t_start, t_last; // t_last: time of the previous dump in seconds
+        std::vector<latencyHistogram> last; // cumulative histograms at the previous dump
+
+        stageProfiler() : local(no_cleanup), n_stages(0), dumping(false), json(false), period(1), t_start(0), t_last(0) {}
+        ~stageProfiler() {
+            stop_dump();
+            for(int i = 0; i < int(threads.size()); i++) delete threads[i];
+        }
+
+        threadData *data() {
+            threadData *d = local.get();
+            if(!d) {
+                d = new threadData;
+                local.reset(d);
+                boost::unique_lock<boost::mutex> lock(mtx);
+                threads.push_back(d);
+            }
+            return d;
+        }
+        void snapshot(std::vector<latencyHistogram> &h); // merge the histograms of all threads
+        void write_interval(double t); // write statistics since the previous dump
+        void dump_loop();
+    public:
+        static stageProfiler &instance() {
+            static stageProfiler p;
+            return p;
+        }
+
+        // Index of a named stage, registered on first use. Look up ids once, outside of the frame loop
+        int stage_id(const std::string &name);
+        std::string stage_name(int id) { return names[id]; }
+        // Add a sample to a stage. Safe to call from any thread, lock-free after its first call on each thread
+        void record(int id, double ms) {
+            if(id < 0 || id >= MAX_STAGES) return;
+            threadData *d = data();
+            boost::atomic<unsigned long long> &c = d->counts[id][latencyHistogram::bin(ms)];
+            c.store(c.load(boost::memory_order_relaxed) + 1, boost::memory_order_relaxed);
+            d->sum_us[id].store(d->sum_us[id].load(boost::memory_order_relaxed) + (unsigned long long)(ms * 1000 + 0.5), boost::memory_order_relaxed);
+        }
+
+        // Write per-stage statistics every 'period_s' seconds to 'filename', as JSON lines if it ends in .json and CSV otherwise
+        bool start_dump(const std::string &filename, double period_s);
+        // Write the last interval and stop the dump thread
+        void stop_dump();
+        // Print a table of statistics of every stage since the program started
+        void print(std::ostream &os);
+};
+
+// Times a stage from construction (or next()) till destruction (or the next call to next())
+class scopedTimer {
+    private:
+        int id;
+        int64 t0;
+    public:
+        scopedTimer(int _id) : id(_id), t0(cv::getTickCount()) {}
+        scopedTimer(const std::string &name) : id(stageProfiler::instance().stage_id(name)), t0(cv::getTickCount()) {}
+        ~scopedTimer() { stop(); }
+        // end the current stage and start timing another one
+        void next(int _id) {
+            int64 t = cv::getTickCount();
+            if(id >= 0) stageProfiler::instance().record(id, 1000. * (t - t0) / cv::getTickFrequency());
+            id = _id;
+            t0 = t;
+        }
+        void stop() { next(-1); }
+};
+
+inline int stageProfiler::stage_id(const std::string &name) {
+    // stages are only ever appended, so already published names can be searched without the lock
+    int n = n_stages.load(boost::memory_order_acquire);
+    for(int i = 0; i < n; i++)
+        if(names[i] == name) return i;
+
+    boost::unique_lock<boost::mutex> lock(mtx);
+    n = n_stages.load(boost::memory_order_relaxed);
+    for(int i = 0; i < n; i++)
+        if(names[i] == name) return i;
+    if(n == MAX_STAGES) {
+        std::cout << "Profiler: too many stages, not timing " << name << std::endl;
+        return -1;
+    }
+    names[n] = name;
+    n_stages.store(n + 1, boost::memory_order_release);
+    return n;
+}
+
+inline void stageProfiler::snapshot(std::vector<latencyHistogram> &h) {
+    int n = n_stages.load(boost::memory_order_acquire);
+    h.assign(n, latencyHistogram());
+    boost::unique_lock<boost::mutex> lock(mtx);
+    for(int t = 0; t < int(threads.size()); t++) {
+        for(int s = 0; s < n; s++) {
+            for(int i = 0; i < latencyHistogram::BINS; i++) {
+                unsigned long long c = threads[t]->counts[s][i].load(boost::memory_order_relaxed);
+                h[s].counts[i] += c;
+                h[s].count += c;
+            }
+            h[s].sum_ms += threads[t]->sum_us[s].load(boost::memory_order_relaxed) / 1000.;
+        }
+    }
+}
+
+inline void stageProfiler::write_interval(double t) {
+    std::vector<latencyHistogram> now;
+    snapshot(now);
+    last.resize(now.size());
+
+    if(json) out << "{\"time\": " << t << ", \"stages\": [";
+    bool first = true;
+    for(int s = 0; s < int(now.size()); s++) {
+        // statistics of this interval only
+        latencyHistogram d;
+        for(int i = 0; i < latencyHistogram::BINS; i++) d.counts[i] = now[s].counts[i] - last[s].counts[i];
+        d.count = now[s].count - last[s].count;
+        d.sum_ms = now[s].sum_ms - last[s].sum_ms;
+        if(d.count == 0) continue;
+
+        double rate = t > t_last ? d.count / (t - t_last) : 0;
+        if(json) {
+            out << (first ? "" : ", ") << "{\"stage\": \"" << names[s] << "\", \"count\": " << d.count << ", \"rate\": " << rate
+                << ", \"mean_ms\": " << d.mean() << ", \"p50_ms\": " << d.percentile(0.50)
+                << ", \"p95_ms\": " << d.percentile(0.95) << ", \"p99_ms\": " << d.percentile(0.99) << "}";
+        }
+        else {
+            out << t << "," << names[s] << "," << d.count << "," << rate << "," << d.mean() << ","
+                << d.percentile(0.50) << "," << d.percentile(0.95) << "," << d.percentile(0.99) << std::endl;
+        }
+        first = false;
+    }
+    if(json) out << "]}" << std::endl;
+    last = now;
+    t_last = t;
+}
+
+inline void stageProfiler::dump_loop() {
+    boost::unique_lock<boost::mutex> lock(dump_mtx);
+    while(dumping) {
+        dump_cv.timed_wait(lock, boost::posix_time::milliseconds(long(period * 1000)));
+        write_interval((cv::getTickCount() - t_start) / cv::getTickFrequency());
+    }
+}
+
+inline bool stageProfiler::start_dump(const std::string &filename, double period_s) {
+    stop_dump();
+    out.open(filename.c_str());
+    if(!out.is_open()) {
+        std::cout << "Profiler: could not open " << filename << " for writing" << std::endl;
+        return false;
+    }
+    json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+    if(!json) out << "time_s,stage,count,rate_hz,mean_ms,p50_ms,p95_ms,p99_ms" << std::endl;
+    period = period_s;
+    t_start = cv::getTickCount();
+    t_last = 0;
+    snapshot(last);
+    dumping = true;
+    dumper = boost::thread(&stageProfiler::dump_loop, this);
+    return true;
+}
+
+inline void stageProfiler::stop_dump() {
+    {
+        boost::unique_lock<boost::mutex> lock(dump_mtx);
+        if(!dumping) return;
+        dumping = false;
+    }
+    dump_cv.notify_all();
+    dumper.join();
+    out.close();
+}
+
+inline void stageProfiler::print(std::ostream &os) {
+    std::vector<latencyHistogram> h;
+    snapshot(h);
+    std::streamsize precision = os.precision();
+    os << std::left << std::setw(16) << "stage" << std::right << std::setw(10) << "count"
+       << std::setw(10) << "mean ms" << std::setw(10) << "p50" << std::setw(10) << "p95" << std::setw(10) << "p99" << std::endl;
+    for(int s = 0; s < int(h.size()); s++) {
+        if(h[s].count == 0) continue;
+        os << std::left << std::setw(16) << names[s] << std::right << std::setw(10) << h[s].count << std::fixed << std::setprecision(3)
+           << std::setw(10) << h[s].mean() << std::setw(10) << h[s].percentile(0.50)
+           << std::setw(10) << h[s].percentile(0.95) << std::setw(10) << h[s].percentile(0.99) << std::endl;
+        os.unsetf(std::ios::fixed);
+        os.precision(precision);
+    }
+}
+
+#endif